@@ -0,0 +1,226 @@
+#include "Aligner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+static long long nanosSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// An aligner of a kernel that says whether there is a qualified overlap
+template<bool (*kernel)(const char*, int, const char*, int, int, double, const OverlapperParams&, SequenceOverlap&, AlignmentWorkspace&)>
+class KernelAligner : public Aligner
+{
+public:
+    explicit KernelAligner(const string &name) : kernelName(name) {}
+
+    string name() const { return kernelName; }
+
+    bool align(const OverlapPair &pair, int minOverlap, double minIdentity, const OverlapperParams &params,
+               SequenceOverlap &overlap)
+    {
+        return kernel(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, overlap, AlignmentWorkspace::local());
+    }
+
+private:
+    string kernelName;
+};
+
+// computeOverlapUngapped for the pairs it applies to, computeOverlapSW2 for
+// the rest, and the profile and lane batches of the ungapped scan
+class UngappedAligner : public Aligner
+{
+public:
+    string name() const { return "ungapped"; }
+
+    bool align(const OverlapPair &pair, int minOverlap, double minIdentity, const OverlapperParams &params,
+               SequenceOverlap &overlap)
+    {
+        return Overlapper::findOverlapUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, overlap);
+    }
+
+    void alignMany(const char *s1, int n1, const vector<OverlapPair> &reads, int minOverlap, double minIdentity,
+                   const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+    {
+        int maxReadLength = 0;
+        for (auto &read: reads) maxReadLength = max(maxReadLength, read.n2);
+        OverlapProfile profile(s1, n1, maxReadLength, params);
+        overlaps = Overlapper::computeOverlapMany(profile, reads, minOverlap, minIdentity, found);
+    }
+
+    void alignBatch(const vector<OverlapPair> &pairs, int minOverlap, double minIdentity,
+                    const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+    {
+        overlaps = Overlapper::computeOverlapBatch(pairs, minOverlap, minIdentity, found, params);
+    }
+
+    int batchWidth() const { return Overlapper::batchWidth(); }
+};
+
+Aligner::~Aligner()
+{
+}
+
+Aligner *Aligner::create(const string &name, bool bReference)
+{
+    if (name == "sw2") return new KernelAligner<Overlapper::findOverlapSW2>(name);
+    if (name == "ungapped") return new UngappedAligner();
+    if (name == "exact") return new KernelAligner<Overlapper::findOverlapExact>(name);
+    if (bReference && name == "wfa") return new KernelAligner<Overlapper::findOverlapWFA>(name);
+    return NULL;
+}
+
+bool Aligner::isKnown(const string &name, bool bReference)
+{
+    Aligner *pAligner = create(name, bReference);
+    delete pAligner;
+    return pAligner != NULL;
+}
+
+Aligner &Aligner::defaultAligner()
+{
+    static UngappedAligner aligner;
+    return aligner;
+}
+
+void Aligner::alignMany(const char *s1, int n1, const vector<OverlapPair> &reads, int minOverlap, double minIdentity,
+                        const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+{
+    alignBatch(reads, minOverlap, minIdentity, params, overlaps, found);
+}
+
+void Aligner::alignBatch(const vector<OverlapPair> &pairs, int minOverlap, double minIdentity,
+                         const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+{
+    overlaps.assign(pairs.size(), SequenceOverlap());
+    found.assign(pairs.size(), false);
+    for (size_t p = 0; p < pairs.size(); ++p)
+        found[p] = align(pairs[p], minOverlap, minIdentity, params, overlaps[p]);
+}
+
+void Aligner::printStats() const
+{
+    fprintf(stderr, "[aligner] backend: %s batch width: %d\n", name().c_str(), batchWidth());
+}
+
+// Whether two aligners found the same overlap, or both found none
+static bool sameOverlap(const SequenceOverlap &a, bool bFoundA, const SequenceOverlap &b, bool bFoundB)
+{
+    if (!bFoundA || !bFoundB) return bFoundA == bFoundB;
+    return a.match[0].start == b.match[0].start && a.match[0].end == b.match[0].end
+           && a.match[1].start == b.match[1].start && a.match[1].end == b.match[1].end
+           && a.length[0] == b.length[0] && a.length[1] == b.length[1]
+           && a.score == b.score && a.edit_distance == b.edit_distance && a.total_columns == b.total_columns
+           && a.cigar == b.cigar;
+}
+
+static string describe(const SequenceOverlap &overlap, bool bFound)
+{
+    if (!bFound) return "no overlap";
+    stringstream ss;
+    ss << overlap << " score: " << overlap.score << " edits: " << overlap.edit_distance;
+    return ss.str();
+}
+
+ShadowAligner::ShadowAligner(Aligner *pPrimary, Aligner *pReference, double rate)
+    : pPrimary(pPrimary), pReference(pReference), rate(rate),
+      numOverlaps(0), numSampled(0), numDifferences(0), primaryNanos(0), sampledPrimaryNanos(0), referenceNanos(0)
+{
+}
+
+ShadowAligner::~ShadowAligner()
+{
+    delete pPrimary;
+    delete pReference;
+}
+
+string ShadowAligner::name() const
+{
+    return pPrimary->name();
+}
+
+bool ShadowAligner::sample(const OverlapPair &pair, int minOverlap, double minIdentity) const
+{
+    // FNV-1a over the sequences and thresholds
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const char *bytes, size_t n) {
+        for (size_t i = 0; i < n; ++i) hash = (hash ^ (unsigned char)bytes[i]) * 0x100000001b3ULL;
+    };
+    mix(pair.s1, pair.n1);
+    mix(pair.s2, pair.n2);
+    mix((const char *)&minOverlap, sizeof(minOverlap));
+    mix((const char *)&minIdentity, sizeof(minIdentity));
+    // The top 53 bits as a fraction in [0, 1)
+    return (hash >> 11) * (1.0 / (1ULL << 53)) < rate;
+}
+
+void ShadowAligner::verify(const OverlapPair &pair, int minOverlap, double minIdentity, const OverlapperParams &params,
+                           const SequenceOverlap &overlap, bool bFound, long long nanos)
+{
+    primaryNanos += nanos;
+    numOverlaps++;
+    if (!sample(pair, minOverlap, minIdentity)) return;
+
+    SequenceOverlap reference;
+    auto start = chrono::steady_clock::now();
+    bool bReferenceFound = pReference->align(pair, minOverlap, minIdentity, params, reference);
+    referenceNanos += nanosSince(start);
+    sampledPrimaryNanos += nanos;
+    numSampled++;
+    if (sameOverlap(overlap, bFound, reference, bReferenceFound)) return;
+
+    numDifferences++;
+    fprintf(stderr, "[shadow aligner] %s: %s %s: %s target: %.*s read: %.*s\n",
+            pPrimary->name().c_str(), describe(overlap, bFound).c_str(),
+            pReference->name().c_str(), describe(reference, bReferenceFound).c_str(),
+            pair.n1, pair.s1, pair.n2, pair.s2);
+}
+
+bool ShadowAligner::align(const OverlapPair &pair, int minOverlap, double minIdentity, const OverlapperParams &params,
+                          SequenceOverlap &overlap)
+{
+    auto start = chrono::steady_clock::now();
+    bool bFound = pPrimary->align(pair, minOverlap, minIdentity, params, overlap);
+    verify(pair, minOverlap, minIdentity, params, overlap, bFound, nanosSince(start));
+    return bFound;
+}
+
+void ShadowAligner::alignMany(const char *s1, int n1, const vector<OverlapPair> &reads, int minOverlap, double minIdentity,
+                              const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+{
+    if (reads.empty()) return;
+    auto start = chrono::steady_clock::now();
+    pPrimary->alignMany(s1, n1, reads, minOverlap, minIdentity, params, overlaps, found);
+    // The time of the reads, shared out evenly
+    long long nanos = nanosSince(start) / (long long)reads.size();
+    for (size_t r = 0; r < reads.size(); ++r)
+        verify(reads[r], minOverlap, minIdentity, params, overlaps[r], found[r], nanos);
+}
+
+void ShadowAligner::alignBatch(const vector<OverlapPair> &pairs, int minOverlap, double minIdentity,
+                               const OverlapperParams &params, vector<SequenceOverlap> &overlaps, vector<bool> &found)
+{
+    if (pairs.empty()) return;
+    auto start = chrono::steady_clock::now();
+    pPrimary->alignBatch(pairs, minOverlap, minIdentity, params, overlaps, found);
+    long long nanos = nanosSince(start) / (long long)pairs.size();
+    for (size_t p = 0; p < pairs.size(); ++p)
+        verify(pairs[p], minOverlap, minIdentity, params, overlaps[p], found[p], nanos);
+}
+
+void ShadowAligner::printStats() const
+{
+    Aligner::printStats();
+    size_t overlaps = numOverlaps.load(), sampled = numSampled.load();
+    fprintf(stderr, "[shadow aligner] overlaps: %zu sampled: %zu differences: %zu\n", overlaps, sampled, numDifferences.load());
+    fprintf(stderr, "[shadow aligner] %s: %.3lfs (%.2lf us per overlap, %.2lf us on the sample) %s: %.3lfs on the sample (%.2lf us per overlap)\n",
+            pPrimary->name().c_str(), primaryNanos.load() * 1e-9,
+            overlaps ? primaryNanos.load() * 1e-3 / overlaps : 0.0, sampled ? sampledPrimaryNanos.load() * 1e-3 / sampled : 0.0,
+            pReference->name().c_str(), referenceNanos.load() * 1e-9, sampled ? referenceNanos.load() * 1e-3 / sampled : 0.0);
+}
@@ -0,0 +1,101 @@
+#ifndef ALIGNER_H
+#define ALIGNER_H
+
+#include "Thirdparty/overlapper.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// The kernel the clips overlap their reads with target regions by. Each
+// backend says whether a qualified overlap exists instead of throwing.
+// Aligners are shared by all threads.
+//
+//   sw2        computeOverlapSW2
+//   ungapped   computeOverlapUngapped where the parameters allow it, with the
+//              reads of a target scanned on one profile (the default); the
+//              same overlaps as sw2
+//   exact      computeOverlapExact, which finds exact overlaps only and so
+//              changes calls
+//
+// The kernels below do not give the calls of SW2 and only serve to check
+// the aligner against, as the reference of a ShadowAligner:
+//
+//   wfa        computeOverlapWFA, which also finds qualified overlaps where
+//              SW2's best endpoints do not qualify, and may score them
+//              differently
+class Aligner
+{
+public:
+    virtual ~Aligner();
+
+    // The aligner of the given name, or NULL if there is none; bReference
+    // admits the kernels that may only serve as a reference
+    static Aligner *create(const std::string& name, bool bReference = false);
+    static bool isKnown(const std::string& name, bool bReference = false);
+    // The aligner clips use unless they are given one
+    static Aligner& defaultAligner();
+
+    virtual std::string name() const = 0;
+
+    // The overlap of pair.s2 with pair.s1; false if no qualified overlap exists
+    virtual bool align(const OverlapPair& pair, int minOverlap, double minIdentity, const OverlapperParams& params,
+                       SequenceOverlap& overlap) = 0;
+    // The same for reads whose s1 all lie in the n1 bases of target s1
+    virtual void alignMany(const char *s1, int n1, const std::vector<OverlapPair>& reads, int minOverlap, double minIdentity,
+                           const OverlapperParams& params, std::vector<SequenceOverlap>& overlaps, std::vector<bool>& found);
+    // The same for pairs with different targets
+    virtual void alignBatch(const std::vector<OverlapPair>& pairs, int minOverlap, double minIdentity,
+                            const OverlapperParams& params, std::vector<SequenceOverlap>& overlaps, std::vector<bool>& found);
+    // The number of pairs alignBatch handles at once; below that, pairs are
+    // better aligned with the other reads of their target
+    virtual int batchWidth() const { return 1; }
+
+    virtual void printStats() const;
+};
+
+// Aligns with a primary aligner, and on a sample of the overlaps also with a
+// reference aligner, to check a faster kernel against a trusted one on real
+// data. Every overlap the two disagree on is logged, and the time of both is
+// reported. Overlaps are sampled at the given rate by a hash of the pair and
+// its thresholds, so that a run samples the same pairs whatever the number
+// of threads and the order they run in.
+class ShadowAligner : public Aligner
+{
+public:
+    // Takes over both aligners
+    ShadowAligner(Aligner *pPrimary, Aligner *pReference, double rate);
+    virtual ~ShadowAligner();
+
+    virtual std::string name() const;
+
+    virtual bool align(const OverlapPair& pair, int minOverlap, double minIdentity, const OverlapperParams& params,
+                       SequenceOverlap& overlap);
+    virtual void alignMany(const char *s1, int n1, const std::vector<OverlapPair>& reads, int minOverlap, double minIdentity,
+                           const OverlapperParams& params, std::vector<SequenceOverlap>& overlaps, std::vector<bool>& found);
+    virtual void alignBatch(const std::vector<OverlapPair>& pairs, int minOverlap, double minIdentity,
+                            const OverlapperParams& params, std::vector<SequenceOverlap>& overlaps, std::vector<bool>& found);
+    virtual int batchWidth() const { return pPrimary->batchWidth(); }
+
+    virtual void printStats() const;
+
+private:
+    bool sample(const OverlapPair& pair, int minOverlap, double minIdentity) const;
+    // Align pair with the reference aligner as well, and log a difference;
+    // nanos is the time the primary aligner took
+    void verify(const OverlapPair& pair, int minOverlap, double minIdentity, const OverlapperParams& params,
+                const SequenceOverlap& overlap, bool bFound, long long nanos);
+
+    Aligner *pPrimary;
+    Aligner *pReference;
+    double rate;
+
+    std::atomic<std::size_t> numOverlaps;
+    std::atomic<std::size_t> numSampled;
+    std::atomic<std::size_t> numDifferences;
+    std::atomic<long long> primaryNanos;
+    std::atomic<long long> sampledPrimaryNanos;
+    std::atomic<long long> referenceNanos;
+};
+
+#endif // ALIGNER_H
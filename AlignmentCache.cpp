@@ -0,0 +1,84 @@
+#include "AlignmentCache.h"
+
+#include <cstdio>
+#include <functional>
+
+using namespace std;
+
+static void combine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+bool AlignmentKey::operator==(const AlignmentKey &other) const
+{
+    return start == other.start && end == other.end && bReversed == other.bReversed && bSeeded == other.bSeeded
+            && minOverlap == other.minOverlap && minIdentity == other.minIdentity
+            && params.match_score == other.params.match_score
+            && params.gap_penalty == other.params.gap_penalty
+            && params.mismatch_penalty == other.params.mismatch_penalty
+            && referenceName == other.referenceName && read == other.read;
+}
+
+size_t AlignmentKey::hash() const
+{
+    size_t seed = std::hash<string>()(read);
+    combine(seed, std::hash<string>()(referenceName));
+    combine(seed, std::hash<int>()(start));
+    combine(seed, std::hash<int>()(end));
+    combine(seed, bReversed);
+    combine(seed, bSeeded);
+    combine(seed, std::hash<int>()(minOverlap));
+    combine(seed, std::hash<double>()(minIdentity));
+    combine(seed, std::hash<int>()(params.match_score));
+    combine(seed, std::hash<int>()(params.gap_penalty));
+    combine(seed, std::hash<int>()(params.mismatch_penalty));
+    return seed;
+}
+
+AlignmentCache::AlignmentCache(size_t capacity)
+    : capacity(capacity), numHits(0), numMisses(0), numEvictions(0)
+{
+    shardCapacity = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+}
+
+bool AlignmentCache::find(const AlignmentKey &key, AlignmentResult &result)
+{
+    if (capacity == 0) return false;
+    Shard& shard = shardOf(key);
+    {
+        lock_guard<mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            result = it->second->second;
+            numHits++;
+            return true;
+        }
+    }
+    numMisses++;
+    return false;
+}
+
+void AlignmentCache::insert(const AlignmentKey &key, const AlignmentResult &result)
+{
+    if (capacity == 0) return;
+    Shard& shard = shardOf(key);
+    lock_guard<mutex> lock(shard.mutex);
+    // Another thread may have computed the same alignment meanwhile
+    if (shard.index.count(key)) return;
+    shard.entries.push_front(make_pair(key, result));
+    shard.index[key] = shard.entries.begin();
+    if (shard.entries.size() > shardCapacity) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+        numEvictions++;
+    }
+}
+
+void AlignmentCache::printStats() const
+{
+    size_t hits = numHits.load(), misses = numMisses.load();
+    fprintf(stderr, "[alignment cache] capacity: %zu hits: %zu misses: %zu hit rate: %.2lf%% evictions: %zu\n",
+            capacity, hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0, numEvictions.load());
+}
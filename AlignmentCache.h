@@ -0,0 +1,81 @@
+#ifndef ALIGNMENTCACHE_H
+#define ALIGNMENTCACHE_H
+
+#include "Thirdparty/overlapper.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Everything computeOverlapSW2 depends on. The target is given by its
+// coordinates rather than its sequence, so a hit also saves fetching it.
+struct AlignmentKey
+{
+    std::string referenceName;
+    int start;
+    int end;
+    bool bReversed;     // both sequences were reversed before the alignment
+    std::string read;
+    int minOverlap;
+    double minIdentity;
+    OverlapperParams params;
+    bool bSeeded;       // aligned only around the seeds of the read
+
+    bool operator==(const AlignmentKey& other) const;
+    std::size_t hash() const;
+};
+
+struct AlignmentKeyHash
+{
+    std::size_t operator()(const AlignmentKey& key) const { return key.hash(); }
+};
+
+struct AlignmentResult
+{
+    bool bFound;        // false if no qualified overlap exists
+    SequenceOverlap overlap;
+};
+
+// Bounded cache of alignment results shared by all worker threads. Duplicate
+// reads at a breakpoint align to the same target regions, so their results
+// are looked up instead of recomputed. The cache is split into shards by key
+// hash, each with its own lock and least recently used eviction.
+class AlignmentCache
+{
+public:
+    // A capacity of 0 disables the cache
+    explicit AlignmentCache(std::size_t capacity);
+
+    bool find(const AlignmentKey& key, AlignmentResult& result);
+    void insert(const AlignmentKey& key, const AlignmentResult& result);
+
+    // Print the hit and miss counts
+    void printStats() const;
+
+private:
+    static const std::size_t NUM_SHARDS = 16;
+
+    typedef std::list<std::pair<AlignmentKey, AlignmentResult> > EntryList;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        EntryList entries;      // most recently used first
+        std::unordered_map<AlignmentKey, EntryList::iterator, AlignmentKeyHash> index;
+    };
+
+    Shard& shardOf(const AlignmentKey& key) { return shards[key.hash() % NUM_SHARDS]; }
+
+    std::size_t capacity;
+    std::size_t shardCapacity;
+    Shard shards[NUM_SHARDS];
+
+    std::atomic<std::size_t> numHits;
+    std::atomic<std::size_t> numMisses;
+    std::atomic<std::size_t> numEvictions;
+};
+
+#endif // ALIGNMENTCACHE_H
@@ -0,0 +1,194 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Lock-free bounded multi-producer/multi-consumer queue (D. Vyukov's array
+// queue). Every cell carries a sequence number telling producers and consumers
+// whose turn it is, so push and pop only contend on a single atomic counter.
+// The blocking push/pop spin (with back-off) while the queue is full/empty and
+// account that time as stalls.
+template<class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t minCapacity);
+    virtual ~BoundedQueue();
+
+    bool tryPush(const T& item);
+    bool tryPop(T& item);
+
+    void push(const T& item);
+    void pop(T& item);
+
+    std::size_t capacity() const { return mask + 1; }
+    std::size_t size() const;
+
+    // Print the depth and stall metrics of the queue
+    void printStats(const std::string& name) const;
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    static void backOff(int& spins);
+    static double secondsSince(const std::chrono::steady_clock::time_point& start);
+    void addStall(std::atomic<long long>& total, double seconds);
+
+    Cell *cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePos;
+    alignas(64) std::atomic<std::size_t> dequeuePos;
+
+    // metrics
+    alignas(64) std::atomic<std::size_t> numPushes;
+    std::atomic<std::size_t> depthSum;
+    std::atomic<std::size_t> maxDepth;
+    std::atomic<long long> pushStallNs;
+    std::atomic<long long> popStallNs;
+};
+
+template<class T>
+BoundedQueue<T>::BoundedQueue(std::size_t minCapacity)
+    : enqueuePos(0), dequeuePos(0),
+      numPushes(0), depthSum(0), maxDepth(0), pushStallNs(0), popStallNs(0)
+{
+    std::size_t cap = 2;
+    while (cap < minCapacity) cap <<= 1;
+    mask = cap - 1;
+    cells = new Cell[cap];
+    for (std::size_t i = 0; i < cap; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template<class T>
+BoundedQueue<T>::~BoundedQueue()
+{
+    delete[] cells;
+}
+
+template<class T>
+bool BoundedQueue<T>::tryPush(const T &item)
+{
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *pCell;
+    while (true) {
+        pCell = &cells[pos & mask];
+        std::size_t seq = pCell->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    pCell->data = item;
+    pCell->sequence.store(pos + 1, std::memory_order_release);
+
+    std::size_t depth = size();
+    numPushes.fetch_add(1, std::memory_order_relaxed);
+    depthSum.fetch_add(depth, std::memory_order_relaxed);
+    std::size_t prev = maxDepth.load(std::memory_order_relaxed);
+    while (depth > prev && !maxDepth.compare_exchange_weak(prev, depth, std::memory_order_relaxed))
+        ;
+    return true;
+}
+
+template<class T>
+bool BoundedQueue<T>::tryPop(T &item)
+{
+    std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell *pCell;
+    while (true) {
+        pCell = &cells[pos & mask];
+        std::size_t seq = pCell->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    item = pCell->data;
+    pCell->data = T();
+    pCell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+template<class T>
+void BoundedQueue<T>::push(const T &item)
+{
+    if (tryPush(item)) return;
+    auto start = std::chrono::steady_clock::now();
+    int spins = 0;
+    do {
+        backOff(spins);
+    } while (!tryPush(item));
+    addStall(pushStallNs, secondsSince(start));
+}
+
+template<class T>
+void BoundedQueue<T>::pop(T &item)
+{
+    if (tryPop(item)) return;
+    auto start = std::chrono::steady_clock::now();
+    int spins = 0;
+    do {
+        backOff(spins);
+    } while (!tryPop(item));
+    addStall(popStallNs, secondsSince(start));
+}
+
+template<class T>
+std::size_t BoundedQueue<T>::size() const
+{
+    std::size_t tail = dequeuePos.load(std::memory_order_relaxed);
+    std::size_t head = enqueuePos.load(std::memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
+
+template<class T>
+void BoundedQueue<T>::printStats(const std::string &name) const
+{
+    std::size_t pushes = numPushes.load();
+    fprintf(stderr, "[queue - %s] capacity: %zu pushes: %zu mean depth: %.2lf max depth: %zu "
+            "push stalls: %.2lfs pop stalls: %.2lfs\n",
+            name.c_str(), capacity(), pushes,
+            pushes ? (double)depthSum.load() / pushes : 0.0, maxDepth.load(),
+            pushStallNs.load() / 1e9, popStallNs.load() / 1e9);
+}
+
+template<class T>
+void BoundedQueue<T>::backOff(int &spins)
+{
+    if (++spins < 64) return;
+    if (spins < 128) std::this_thread::yield();
+    else std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+template<class T>
+double BoundedQueue<T>::secondsSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<class T>
+void BoundedQueue<T>::addStall(std::atomic<long long> &total, double seconds)
+{
+    total.fetch_add((long long)(seconds * 1e9), std::memory_order_relaxed);
+}
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,38 @@
+#include "ClipBatcher.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+ClipBatcher::ClipBatcher(ClipReader &reader, int window, size_t maxSize)
+    : reader(reader), window(window), maxSize(maxSize), pNext(NULL)
+{
+}
+
+ClipBatcher::~ClipBatcher()
+{
+    delete pNext;
+}
+
+bool ClipBatcher::next(vector<AbstractClip*> &batch)
+{
+    batch.clear();
+    if (pNext == NULL) pNext = reader.nextClip();
+    if (pNext == NULL) return false;
+
+    batch.push_back(pNext);
+    pNext = NULL;
+    while (batch.size() < maxSize && (pNext = reader.nextClip())) {
+        if (!joins(batch.front(), pNext)) break;
+        batch.push_back(pNext);
+        pNext = NULL;
+    }
+    return true;
+}
+
+bool ClipBatcher::joins(AbstractClip *pFirst, AbstractClip *pClip)
+{
+    return pClip->getReferenceId() == pFirst->getReferenceId()
+            && abs(pClip->getClipPosition() - pFirst->getClipPosition()) <= window
+            && pClip->getType() == pFirst->getType();
+}
@@ -0,0 +1,30 @@
+#ifndef CLIPBATCHER_H
+#define CLIPBATCHER_H
+
+#include "ClipReader.h"
+
+#include <vector>
+
+// Groups consecutive clips of a ClipReader that have the same type and lie
+// within a few bases of each other. The clips of a real breakpoint come in
+// such runs and look for almost the same spanning pairs, so a batch is called
+// with one query for all of them.
+class ClipBatcher
+{
+public:
+    ClipBatcher(ClipReader& reader, int window = 50, std::size_t maxSize = 64);
+    virtual ~ClipBatcher();
+
+    // Fill batch with the next clips; false once the reader is exhausted
+    bool next(std::vector<AbstractClip*>& batch);
+
+private:
+    bool joins(AbstractClip *pFirst, AbstractClip *pClip);
+
+    ClipReader& reader;
+    int window;
+    std::size_t maxSize;
+    AbstractClip *pNext;    // read ahead, but did not join the last batch
+};
+
+#endif // CLIPBATCHER_H
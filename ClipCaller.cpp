@@ -0,0 +1,167 @@
+#include "ClipCaller.h"
+#include "error.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <utility>
+
+using namespace std;
+
+ClipCaller::ClipCaller(const string &bamFile, const string &refFile, const CallParams &params,
+                       AlignmentCache *pCache, ResidentReference *pResident, const MappedFasta *pMapped)
+    : source(reader), faidx(refFile, params.refCacheBlocks), params(params), pCache(pCache),
+      numClips(0), numBatches(0), numSharedRegions(0), numSeedWindows(0)
+{
+    if (!reader.Open(bamFile))
+        error("Could not open the input BAM file.");
+    if (!reader.LocateIndex())
+        error("Could not locate the index file");
+    if (pResident != NULL) faidx.setResident(pResident);
+    if (pMapped != NULL) faidx.setMapping(pMapped);
+}
+
+ClipCaller::~ClipCaller()
+{
+    reader.Close();
+}
+
+void ClipCaller::call(const vector<AbstractClip*> &clips, vector<Deletion> &deletions)
+{
+    if (clips.empty()) return;
+    numBatches++;
+    numClips += clips.size();
+
+    int referenceId = clips.front()->getReferenceId();
+    string refName = Helper::getReferenceName(reader, referenceId);
+
+    // One query covering the spanning regions of all clips that need one
+    int left = INT_MAX, right = INT_MIN;
+    int start, end;
+    for (auto pClip: clips) {
+        if (pClip->hasSpanningRecords() || !pClip->spanningRegion(params.insLength, start, end)) continue;
+        if (start > end) continue;
+        if (start - 1 < left) left = start - 1;
+        if (end > right) right = end;
+    }
+    // A read of the BAM or reference file that fails takes down the clips
+    // that depend on it as CLIP_ERROR, never the thread
+    vector<PairRecord> records;
+    bool bShared = true;
+    try {
+        if (left < right) source.fetch(referenceId, left, right, records);
+    } catch (ErrorException& ex) {
+        bShared = false;
+        records.clear();
+    }
+    PrefetchedPairSource shared(records);
+
+    // The target regions of the clips that search for spanning pairs only
+    // depend on their position and length. All regions are found first, so
+    // that the window they fall into can be indexed once for the batch
+    map<pair<int, int>, vector<TargetRegion> > regionCache;
+    map<pair<int, int>, ClipStatus> statusCache;
+    vector<vector<TargetRegion> > ownRegions(clips.size());
+    vector<const vector<TargetRegion>*> targets(clips.size());
+    vector<ClipStatus> statuses(clips.size());
+    for (size_t i = 0; i < clips.size(); ++i) {
+        AbstractClip *pClip = clips[i];
+        bool bCacheable = pClip->spanningRegion(params.insLength, start, end);
+        pair<int, int> key(pClip->getClipPosition(), pClip->length());
+        if (bCacheable && regionCache.count(key)) {
+            numSharedRegions++;
+            statuses[i] = statusCache[key];
+        } else {
+            vector<TargetRegion> regions;
+            try {
+                PairSource& pairs = bCacheable ? (PairSource&)shared : source;
+                if (bCacheable && !bShared && !pClip->hasSpanningRecords())
+                    statuses[i] = CLIP_ERROR;
+                else
+                    statuses[i] = pClip->findTargetRegions(pairs, refName, params.insLength, params.minMapQual, regions);
+            } catch (ErrorException& ex) {
+                statuses[i] = CLIP_ERROR;
+                regions.clear();
+            }
+            if (bCacheable) {
+                regionCache[key] = regions;
+                statusCache[key] = statuses[i];
+            } else {
+                ownRegions[i].swap(regions);
+            }
+        }
+        targets[i] = bCacheable ? &regionCache[key] : &ownRegions[i];
+    }
+
+    // The overlaps of all clips are gathered and aligned together, so that
+    // the clips sharing target regions share their fetch and profile, then
+    // every clip is called with its overlaps at hand
+    SeedIndex *pIndex = params.bSeeded ? buildSeedIndex(clips, targets, refName) : NULL;
+    OverlapBatch batch;
+    for (size_t i = 0; i < clips.size(); ++i) {
+        if (statuses[i] != CLIP_CALLED) continue;
+        clips[i]->setSeedIndex(pIndex);
+        clips[i]->setExactFirst(params.bExactFirst);
+        clips[i]->setAligner(params.pAligner);
+        try {
+            clips[i]->addOverlaps(faidx, pCache, *targets[i], params.minOverlap, params.minIdentity, batch);
+        } catch (ErrorException& ex) {
+            statuses[i] = CLIP_ERROR;
+            clips[i]->setSeedIndex(NULL);
+        }
+    }
+    // Should the batch fail, the clips compute their overlaps one by one
+    const OverlapBatch *pBatch = &batch;
+    try {
+        batch.align(pCache, params.pAligner != NULL ? *params.pAligner : Aligner::defaultAligner());
+    } catch (ErrorException& ex) {
+        pBatch = NULL;
+    }
+    for (size_t i = 0; i < clips.size(); ++i) {
+        if (statuses[i] == CLIP_CALLED) {
+            clips[i]->setOverlapBatch(pBatch);
+            try {
+                statuses[i] = clips[i]->call(faidx, pCache, *targets[i], params.minOverlap, params.minIdentity, deletions);
+            } catch (ErrorException& ex) {
+                statuses[i] = CLIP_ERROR;
+            }
+            clips[i]->setOverlapBatch(NULL);
+            clips[i]->setSeedIndex(NULL);
+        }
+        AbstractClip::countStatus(statuses[i]);
+    }
+    delete pIndex;
+}
+
+SeedIndex *ClipCaller::buildSeedIndex(const vector<AbstractClip*> &clips, const vector<const vector<TargetRegion>*> &targets,
+                                      const string &refName)
+{
+    int left = INT_MAX, right = INT_MIN;
+    for (auto pRegions: targets) {
+        for (auto &region: *pRegions) {
+            left = min(left, region.start);
+            right = max(right, region.end);
+        }
+    }
+    if (left < 1 || left > right || right - left + 1 > MAX_SEED_WINDOW) return NULL;
+
+    // Seeds short enough for every clip of the batch
+    int seedLength = SeedIndex::MAX_K;
+    for (auto pClip: clips)
+        seedLength = min(seedLength, Overlapper::minSeedLength(pClip->length(), params.minOverlap, params.minIdentity));
+    if (seedLength < MIN_SEED_LENGTH) return NULL;
+
+    // Without the window, the batch runs unseeded; the clips will meet the
+    // same error on their own
+    string window;
+    try {
+        window = faidx.fetch(refName, left, right);
+    } catch (ErrorException& ex) {
+        return NULL;
+    }
+    // The window was clipped to the end of the reference
+    if ((int)window.size() != right - left + 1) return NULL;
+    numSeedWindows++;
+    return new SeedIndex(refName, left, window, seedLength);
+}
@@ -0,0 +1,85 @@
+#ifndef CLIPCALLER_H
+#define CLIPCALLER_H
+
+#include "Aligner.h"
+#include "AlignmentCache.h"
+#include "api/BamReader.h"
+#include "clip.h"
+#include "Deletion.h"
+#include "FaidxWrapper.h"
+#include "PairSource.h"
+#include "SeedIndex.h"
+
+#include <string>
+#include <vector>
+
+struct CallParams
+{
+    int insLength;
+    int minOverlap;
+    double minIdentity;
+    int minMapQual;
+    int refCacheBlocks;     // blocks of the reference kept in memory by each thread
+    bool bExactFirst;       // take an exact overlap where there is one (see AbstractClip::setExactFirst)
+    bool bSeeded;           // align only around the seeds of the reads (see AbstractClip::setSeedIndex)
+    Aligner *pAligner;      // shared by all threads; NULL for Aligner::defaultAligner
+};
+
+// Everything one thread needs to call clips: its own BAM reader for the
+// spanning pair queries and its own faidx handle, neither of which may be
+// shared between threads. The alignment cache and the resident or mapped
+// reference (if any) are shared.
+class ClipCaller
+{
+public:
+    ClipCaller(const std::string& bamFile, const std::string& refFile, const CallParams& params,
+               AlignmentCache *pCache = NULL, ResidentReference *pResident = NULL,
+               const MappedFasta *pMapped = NULL);
+    virtual ~ClipCaller();
+
+    // Call a batch of nearby clips on one reference (see ClipBatcher). The
+    // spanning pairs of the whole batch are fetched with a single query, and
+    // clips with the same type, position and length share their target regions.
+    // With params.bSeeded, the window of the reference the regions of the
+    // batch fall into is indexed once, and the clips align only around their
+    // seeds in it.
+    // The overlaps of all clips are aligned together, each target region
+    // fetched once and aligned once for all reads aligned to it (see
+    // OverlapBatch).
+    void call(const std::vector<AbstractClip*>& clips, std::vector<Deletion>& deletions);
+
+    // Hold the resident chromosome the next clips are on, or let go of it
+    // (see FaidxWrapper::hold)
+    void holdReference(const std::string& refName) { faidx.hold(refName); }
+    void releaseReference() { faidx.release(); }
+
+    std::size_t getNumClips() const { return numClips; }
+    std::size_t getNumBatches() const { return numBatches; }
+    std::size_t getNumSharedRegions() const { return numSharedRegions; }
+    std::size_t getNumSeedWindows() const { return numSeedWindows; }
+    const FaidxWrapper& getFaidx() const { return faidx; }
+
+private:
+    // Windows longer than this are not indexed
+    static const int MAX_SEED_WINDOW = 1 << 20;
+    // Shorter seeds would hit almost every region
+    static const int MIN_SEED_LENGTH = 8;
+
+    // The index of the window the regions of a batch fall into, or NULL if
+    // the seeds would be too short for the clips or the window too long
+    SeedIndex *buildSeedIndex(const std::vector<AbstractClip*>& clips,
+                              const std::vector<const std::vector<TargetRegion>*>& targets, const std::string& refName);
+
+    BamTools::BamReader reader;
+    BamPairSource source;
+    FaidxWrapper faidx;
+    CallParams params;
+    AlignmentCache *pCache;
+
+    std::size_t numClips;
+    std::size_t numBatches;
+    std::size_t numSharedRegions;
+    std::size_t numSeedWindows;
+};
+
+#endif // CLIPCALLER_H
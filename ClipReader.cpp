@@ -6,8 +6,10 @@ using namespace std;
 using namespace BamTools;
 
 ClipReader::ClipReader(const string &filename, int allowedNum, int mode, int minMapQual, int isizeCutoff)
-    : allowedNum(allowedNum), mode(mode), minMapQual(minMapQual), isizeCutoff(isizeCutoff)
+    : filename(filename), allowedNum(allowedNum), mode(mode), minMapQual(minMapQual), isizeCutoff(isizeCutoff),
+      bShard(false), bSinglePass(false), insLength(0)
 {
+    resetStream();
     if (!reader.Open(filename))
         error("Could not open the input BAM file.");
     if (!reader.LocateIndex())
@@ -16,14 +18,50 @@ ClipReader::ClipReader(const string &filename, int allowedNum, int mode, int min
 
 ClipReader::~ClipReader()
 {
+    resetStream();
     reader.Close();
 }
 
+ClipReader *ClipReader::clone() const
+{
+    ClipReader *pReader = new ClipReader(filename, allowedNum, mode, minMapQual, isizeCutoff);
+    if (bSinglePass) pReader->setSinglePass(insLength);
+    return pReader;
+}
+
 bool ClipReader::setRegion(int leftRefId, int leftPosition, int rightRefId, int rightPosition)
 {
+    resetStream();
+    bShard = false;
     return reader.SetRegion(leftRefId, leftPosition, rightRefId, rightPosition);
 }
 
+bool ClipReader::setShard(const Shard &shard)
+{
+    resetStream();
+    if (!reader.SetRegion(shard.referenceId, shard.flankedStart() - 1, shard.referenceId, shard.flankedEnd()))
+        return false;
+    this->shard = shard;
+    bShard = true;
+    return true;
+}
+
+void ClipReader::setSinglePass(int insLength)
+{
+    bSinglePass = true;
+    this->insLength = insLength;
+}
+
+void ClipReader::resetStream()
+{
+    for (auto pClip: pending) delete pClip;
+    pending.clear();
+    window.clear();
+    streamRefId = -1;
+    streamPos = -1;
+    bEndOfStream = false;
+}
+
 int ClipReader::getReferenceId(const string &referenceName)
 {
     return reader.GetReferenceID(referenceName);
@@ -35,9 +73,89 @@ string ClipReader::getReferenceName(int referenceId)
     return reader.GetReferenceData()[referenceId].RefName;
 }
 
+int ClipReader::getReferenceCount()
+{
+    return reader.GetReferenceCount();
+}
+
+int ClipReader::getReferenceLength(int referenceId)
+{
+    assert(referenceId >= 0 && referenceId < reader.GetReferenceCount());
+    return reader.GetReferenceData()[referenceId].RefLength;
+}
+
 AbstractClip *ClipReader::nextClip() {
+    if (!bSinglePass) return readOwnedClip();
+
+    while (true) {
+        if (!pending.empty() && isReady(pending.front())) return release();
+        if (bEndOfStream) return pending.empty() ? NULL : release();
+        AbstractClip *pClip = readOwnedClip();
+        if (pClip == NULL) bEndOfStream = true;
+        else pending.push_back(pClip);
+    }
+}
+
+AbstractClip *ClipReader::readOwnedClip() {
+    AbstractClip *pClip;
+    while ((pClip = readClip())) {
+        if (!bShard || shard.owns(pClip->getClipPosition())) return pClip;
+        delete pClip;
+    }
+    return NULL;
+}
+
+bool ClipReader::isReady(AbstractClip *pClip)
+{
+    int start, end;
+    if (!pClip->spanningRegion(insLength, start, end)) return true;
+    // The stream is sorted, so no record that starts before end is still to come
+    return pClip->getReferenceId() < streamRefId || end <= streamPos;
+}
+
+AbstractClip *ClipReader::release()
+{
+    AbstractClip *pClip = pending.front();
+    pending.pop_front();
+
+    int start, end;
+    if (pClip->spanningRegion(insLength, start, end)) {
+        vector<PairRecord> records;
+        if (start <= end) window.fetch(pClip->getReferenceId(), start - 1, end, records);
+        pClip->setSpanningRecords(records);
+    }
+
+    // Keep what the held back clips and the clips still to be read may ask for
+    int boundRefId = streamRefId;
+    int bound = streamPos - insLength - 1;
+    for (auto pc: pending) {
+        if (!pc->spanningRegion(insLength, start, end)) continue;
+        if (pc->getReferenceId() < boundRefId ||
+                (pc->getReferenceId() == boundRefId && start - 1 < bound)) {
+            boundRefId = pc->getReferenceId();
+            bound = start - 1;
+        }
+    }
+    window.evict(boundRefId, bound);
+
+    return pClip;
+}
+
+AbstractClip *ClipReader::readClip() {
     BamAlignment al;
     while (reader.GetNextAlignment(al)) {
+        if (bSinglePass) {
+            if (al.RefID >= 0) {
+                streamRefId = al.RefID;
+                streamPos = al.Position;
+                PairRecord record = PairRecord::fromAlignment(al);
+                if (record.isCandidate()) window.add(record);
+            } else {
+                // Unplaced reads sort after every reference, so the stream is
+                // past all the regions a pending clip may ask for
+                streamRefId = reader.GetReferenceCount();
+            }
+        }
         vector<int> clipSizes, readPositions, genomePositions;
 //        if (!al.GetSoftClips(clipSizes, readPositions, genomePositions)) continue;
         if (al.MapQuality < minMapQual || !al.GetSoftClips(clipSizes, readPositions, genomePositions)) continue;
@@ -2,6 +2,10 @@
 #define CLIPREADER_H
 
 #include "clip.h"
+#include "PairSource.h"
+#include "Shard.h"
+
+#include <deque>
 
 class ClipReader
 {
@@ -10,21 +14,50 @@ public:
     ClipReader(const std::string& filename, int allowedNum, int mode, int minMapQual, int isizeCutoff);
     virtual ~ClipReader();
 
+    // Open another reader on the same file with the same settings
+    ClipReader* clone() const;
+
     bool setRegion(int leftRefId, int leftPosition, int rightRefId, int rightPosition);
+    // Read the flanked shard and only return the clips it owns
+    bool setShard(const Shard& shard);
+
+    // Collect the spanning pairs of every clip from the records streamed
+    // through the reader, so that the BAM file is only read once. Clips are
+    // held back until the stream has passed their spanning region.
+    void setSinglePass(int insLength);
 
     int getReferenceId(const std::string& referenceName);
     std::string getReferenceName(int referenceId);
+    int getReferenceCount();
+    int getReferenceLength(int referenceId);
 
     int getAllowedNum() const;
 
     AbstractClip* nextClip();
 
 private:    
+    AbstractClip* readClip();
+    AbstractClip* readOwnedClip();
+    bool isReady(AbstractClip *pClip);
+    AbstractClip* release();
+    void resetStream();
+
     BamTools::BamReader reader;
+    std::string filename;
     int allowedNum;
     int mode;
     int minMapQual;
     int isizeCutoff;
+    bool bShard;
+    Shard shard;
+
+    bool bSinglePass;
+    int insLength;
+    WindowPairSource window;
+    std::deque<AbstractClip*> pending;
+    int streamRefId;
+    int streamPos;
+    bool bEndOfStream;
 
     bool inEnhancedMode() const;
 };
@@ -47,7 +47,8 @@ bool Deletion::operator<(const Deletion &other) const
     if (start1 != other.start1) return start1 < other.start1;
     if (start2 != other.start2) return start2 < other.start2;
     if (end1 != other.end1) return end1 < other.end1;
-    return end2 < other.end2;
+    if (end2 != other.end2) return end2 < other.end2;
+    return fromTag < other.fromTag;
 }
 
 bool Deletion::operator==(const Deletion &other) const
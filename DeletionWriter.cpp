@@ -0,0 +1,70 @@
+#include "DeletionWriter.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+DeletionWriter::DeletionWriter(const string &filename, const vector<string> &referenceNames)
+    : filename(filename),
+      nameOrder(referenceNames.size()),
+      buckets(referenceNames.size()),
+      complete(referenceNames.size(), false),
+      numEmitted(0),
+      numWritten(0)
+{
+    iota(nameOrder.begin(), nameOrder.end(), 0);
+    sort(nameOrder.begin(), nameOrder.end(),
+         [&referenceNames](size_t i1, size_t i2) { return referenceNames[i1] < referenceNames[i2]; });
+}
+
+DeletionWriter::~DeletionWriter()
+{
+}
+
+void DeletionWriter::add(int referenceId, const Deletion &del)
+{
+    assert(referenceId >= 0 && referenceId < (int)buckets.size() && !complete[referenceId]);
+    buckets[referenceId].push_back(del);
+}
+
+void DeletionWriter::finishReferencesBefore(int referenceId)
+{
+    for (int i = 0; i < referenceId && i < (int)complete.size(); ++i)
+        complete[i] = true;
+    flush();
+}
+
+void DeletionWriter::close()
+{
+    finishReferencesBefore(complete.size());
+    if (out.is_open()) out.close();
+}
+
+void DeletionWriter::flush()
+{
+    while (numEmitted < nameOrder.size() && complete[nameOrder[numEmitted]]) {
+        write(buckets[nameOrder[numEmitted]]);
+        ++numEmitted;
+    }
+}
+
+void DeletionWriter::write(vector<Deletion> &dels)
+{
+    if (dels.empty()) return;
+
+    sort(dels.begin(), dels.end());
+    dels.erase(unique(dels.begin(), dels.end()), dels.end());
+
+    vector<Deletion> finalDels;
+    merge(dels, finalDels,
+          [](const Deletion& d1, const Deletion& d2){ return d1.overlaps(d2); });
+
+    if (!out.is_open()) out.open(filename.c_str());
+    for (auto &d: finalDels) {
+        numWritten++;
+        out << d << "\tDEL." << numWritten << "." << d.getFromTag() << endl;
+    }
+    vector<Deletion>().swap(dels);
+}
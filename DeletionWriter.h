@@ -0,0 +1,43 @@
+#ifndef DELETIONWRITER_H
+#define DELETIONWRITER_H
+
+#include "Deletion.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Collects deletions per reference and writes them out as soon as the output
+// order allows it. The calls of a reference are sorted, deduplicated and
+// merged once the reference is complete, and references are written in the
+// order of their names, so the file is the same as when everything is merged
+// at the end. The file is only created when there is something to write.
+class DeletionWriter
+{
+public:
+    DeletionWriter(const std::string& filename, const std::vector<std::string>& referenceNames);
+    virtual ~DeletionWriter();
+
+    void add(int referenceId, const Deletion& del);
+
+    // Declare that all references with a smaller id have been called
+    void finishReferencesBefore(int referenceId);
+    // Declare that all references have been called
+    void close();
+
+    std::size_t size() const { return numWritten; }
+
+private:
+    void flush();
+    void write(std::vector<Deletion>& dels);
+
+    std::string filename;
+    std::ofstream out;
+    std::vector<std::size_t> nameOrder;
+    std::vector<std::vector<Deletion> > buckets;
+    std::vector<bool> complete;
+    std::size_t numEmitted;
+    std::size_t numWritten;
+};
+
+#endif // DELETIONWRITER_H
@@ -1,10 +1,13 @@
 #include "FaidxWrapper.h"
 #include "error.h"
 #include <algorithm>
+#include <cstdlib>
 
 using namespace std;
 
-FaidxWrapper::FaidxWrapper(const std::string &fasta)
+FaidxWrapper::FaidxWrapper(const std::string &fasta, size_t cacheBlocks, int blockSize)
+    : cacheBlocks(cacheBlocks), blockSize(blockSize), pResident(NULL), pMapped(NULL),
+      numFetches(0), numHits(0), numBlocksRead(0), numReadAhead(0), bytesRead(0), numGathered(0)
 {
     fai = fai_load(fasta.c_str());
     if (fai == NULL) error("Cannot load the indexed fasta.");
@@ -15,17 +18,149 @@ FaidxWrapper::~FaidxWrapper()
     if (fai != NULL) fai_destroy(fai);
 }
 
+void FaidxWrapper::setResident(ResidentReference *pResident)
+{
+    this->pResident = pResident;
+}
+
+void FaidxWrapper::setMapping(const MappedFasta *pMapped)
+{
+    this->pMapped = pMapped;
+}
+
+void FaidxWrapper::hold(const string &chrom)
+{
+    if (pResident == NULL || (pSequence && chrom == residentName)) return;
+    // Let go of the previous chromosome first, so it can be freed
+    pSequence.reset();
+    pSequence = pResident->acquire(chrom);
+    residentName = chrom;
+}
+
+void FaidxWrapper::release()
+{
+    pSequence.reset();
+    residentName.clear();
+}
+
 int FaidxWrapper::size()
 {
     return faidx_nseq(fai);
 }
 
 string FaidxWrapper::fetch(const string &chrom, int start, int end)
+{
+    if (pMapped != NULL) return fetchMapped(chrom, start, end).str();
+    numFetches++;
+    if (pResident != NULL) return fetchResident(chrom, start, end);
+    if (cacheBlocks == 0) return read(chrom, start - 1, end - 1);
+
+    int length = sequenceLength(chrom);
+    int begin, last;
+    clip(length, start, end, begin, last);
+
+    size_t numBlocksBefore = numBlocksRead;
+    string str;
+    str.reserve(last - begin + 1);
+    for (int blockId = begin / blockSize; blockId <= last / blockSize; ++blockId) {
+        BlockKey key(chrom, blockId);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            loadBlock(chrom, length, blockId);
+            // Read ahead along the frontier
+            if (cacheBlocks > 1 && (blockId + 1) * blockSize < length && !hasBlock(BlockKey(chrom, blockId + 1))) {
+                loadBlock(chrom, length, blockId + 1);
+                numReadAhead++;
+            }
+            it = index.find(key);
+        }
+        blocks.splice(blocks.begin(), blocks, it->second);
+        const string& block = it->second->second;
+        int offset = blockId * blockSize;
+        int from = max(begin, offset) - offset;
+        int to = min(last, offset + (int)block.size() - 1) - offset;
+        str.append(block, from, to - from + 1);
+    }
+    if (numBlocksRead == numBlocksBefore) numHits++;
+    return str;
+}
+
+void FaidxWrapper::clip(int length, int start, int end, int &begin, int &last)
+{
+    begin = start - 1;
+    last = end - 1;
+    if (last < begin) begin = last;
+    begin = max(0, min(begin, length - 1));
+    last = max(0, min(last, length - 1));
+}
+
+string FaidxWrapper::fetchResident(const string &chrom, int start, int end)
+{
+    if (pSequence && chrom == residentName)
+        numHits++;
+    else
+        hold(chrom);
+    if (pSequence->length() == 0) return string();
+    int begin, last;
+    clip(pSequence->length(), start, end, begin, last);
+    string str;
+    str.reserve(last - begin + 1);
+    pSequence->decode(begin, last, str);
+    return str;
+}
+
+SequenceView FaidxWrapper::fetchView(const string &chrom, int start, int end)
+{
+    if (pMapped != NULL) return fetchMapped(chrom, start, end);
+    viewBuffer = fetch(chrom, start, end);
+    return { viewBuffer.data(), (int)viewBuffer.size() };
+}
+
+SequenceView FaidxWrapper::fetchMapped(const string &chrom, int start, int end)
+{
+    numFetches++;
+    int length = pMapped->sequenceLength(chrom);
+    if (length < 0) error("cannot fetch the reference sequence");
+    if (length == 0) return { viewBuffer.data(), 0 };
+    int begin, last;
+    clip(length, start, end, begin, last);
+    bool bGathered;
+    SequenceView view = pMapped->view(chrom, begin, last, viewBuffer, bGathered);
+    if (bGathered) numGathered++;
+    return view;
+}
+
+string FaidxWrapper::read(const string &chrom, int begin, int end)
 {
     int len;
-    char *s = faidx_fetch_seq(fai, (char *)chrom.c_str(), start - 1, end - 1, &len);
+    char *s = faidx_fetch_seq(fai, (char *)chrom.c_str(), begin, end, &len);
     if (s == NULL) error("cannot fetch the reference sequence");
     string str(s);
+    free(s);
+    bytesRead += str.size();
     transform(str.begin(), str.end(), str.begin(), ::toupper);
     return str;
 }
+
+int FaidxWrapper::sequenceLength(const string &chrom)
+{
+    auto it = lengths.find(chrom);
+    if (it != lengths.end()) return it->second;
+    int length = faidx_seq_len(fai, chrom.c_str());
+    if (length < 0) error("cannot fetch the reference sequence");
+    lengths[chrom] = length;
+    return length;
+}
+
+void FaidxWrapper::loadBlock(const string &chrom, int length, int blockId)
+{
+    int begin = blockId * blockSize;
+    int end = min(begin + blockSize, length) - 1;
+    blocks.push_front(make_pair(BlockKey(chrom, blockId), read(chrom, begin, end)));
+    index[blocks.front().first] = blocks.begin();
+    numBlocksRead++;
+    while (blocks.size() > cacheBlocks) {
+        index.erase(blocks.back().first);
+        blocks.pop_back();
+    }
+}
@@ -2,18 +2,94 @@
 #define FAIDXWRAPPER_H
 
 #include "htslib/faidx.h"
+#include "MappedFasta.h"
+#include "ResidentReference.h"
+
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
+// Fetches (uppercased) reference sequences from an indexed FASTA file.
+// Optionally keeps the most recently used fixed-size blocks of the reference
+// in memory, so that the many small fetches around a breakpoint are served
+// without reading (and for bgzip files, decompressing) the file again. When a
+// block has to be read, the next block is read along with it, as clips are
+// processed in genome order.
+// Alternatively the fetches are decoded from the packed chromosome held by a
+// ResidentReference, which is swapped when the fetches move to another
+// chromosome, or taken directly from a MappedFasta.
+// A FaidxWrapper must not be shared between threads.
 class FaidxWrapper
 {
 public:
-    FaidxWrapper(const std::string& fasta);
+    static const int DEFAULT_BLOCK_SIZE = 16384;
+
+    // Keep up to cacheBlocks blocks of blockSize bases; 0 disables the cache
+    FaidxWrapper(const std::string& fasta, std::size_t cacheBlocks = 0, int blockSize = DEFAULT_BLOCK_SIZE);
     virtual ~FaidxWrapper();
+
+    // Serve all fetches from the chromosomes held by pResident
+    void setResident(ResidentReference *pResident);
+    // Serve all fetches from the mapped FASTA file
+    void setMapping(const MappedFasta *pMapped);
+    // Make chrom the resident chromosome ahead of its fetches, or let go of
+    // the resident chromosome; no-ops unless fetches come from a
+    // ResidentReference
+    void hold(const std::string& chrom);
+    void release();
+
     int size();
+    // Bases start to end (1-based, inclusive), clipped to the sequence
     std::string fetch(const std::string& chrom, int start, int end);
+    // The same without copying the bases where possible; the view is valid
+    // until the next fetch
+    SequenceView fetchView(const std::string& chrom, int start, int end);
+
+    std::size_t getNumFetches() const { return numFetches; }
+    std::size_t getNumHits() const { return numHits; }
+    std::size_t getNumBlocksRead() const { return numBlocksRead; }
+    std::size_t getNumReadAhead() const { return numReadAhead; }
+    std::size_t getBytesRead() const { return bytesRead; }
+    std::size_t getNumGathered() const { return numGathered; }
 
 private:
+    typedef std::pair<std::string, int> BlockKey;
+    typedef std::list<std::pair<BlockKey, std::string> > BlockList;
+
+    // Clip [start, end] (1-based) to a sequence the same way faidx_fetch_seq does
+    static void clip(int length, int start, int end, int& begin, int& last);
+    std::string fetchResident(const std::string& chrom, int start, int end);
+    SequenceView fetchMapped(const std::string& chrom, int start, int end);
+    // Read bases [begin, end] (0-based, inclusive) from the file
+    std::string read(const std::string& chrom, int begin, int end);
+    int sequenceLength(const std::string& chrom);
+    bool hasBlock(const BlockKey& key) const { return index.count(key) > 0; }
+    void loadBlock(const std::string& chrom, int length, int blockId);
+
     faidx_t *fai;
+
+    std::size_t cacheBlocks;
+    int blockSize;
+    BlockList blocks;       // most recently used first
+    std::map<BlockKey, BlockList::iterator> index;
+    std::unordered_map<std::string, int> lengths;
+
+    ResidentReference *pResident;
+    std::string residentName;
+    std::shared_ptr<const PackedSequence> pSequence;
+
+    const MappedFasta *pMapped;
+    std::string viewBuffer;
+
+    std::size_t numFetches;
+    std::size_t numHits;
+    std::size_t numBlocksRead;
+    std::size_t numReadAhead;
+    std::size_t bytesRead;
+    std::size_t numGathered;
 };
 
 #endif // FAIDXWRAPPER_H
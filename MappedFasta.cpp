@@ -0,0 +1,89 @@
+#include "MappedFasta.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFasta::MappedFasta(const string &fasta)
+    : data(NULL), size(0)
+{
+    int fd = open(fasta.c_str(), O_RDONLY);
+    if (fd < 0) error("Cannot open the reference file.");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        error("Cannot open the reference file.");
+    }
+    size = st.st_size;
+    void *p = size > 0 ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) error("Cannot map the reference file into memory.");
+    data = (const char *)p;
+
+    if (size >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b) {
+        munmap((void *)data, size);
+        error("Mapping the reference into memory needs an uncompressed FASTA file.");
+    }
+    loadIndex(fasta + ".fai");
+}
+
+MappedFasta::~MappedFasta()
+{
+    if (data != NULL) munmap((void *)data, size);
+}
+
+void MappedFasta::loadIndex(const string &filename)
+{
+    ifstream in(filename.c_str());
+    if (!in) error("Cannot load the indexed fasta.");
+    string line;
+    while (getline(in, line)) {
+        istringstream ss(line);
+        string name;
+        IndexEntry entry;
+        if (!(ss >> name >> entry.length >> entry.offset >> entry.lineBases >> entry.lineWidth)
+                || entry.lineBases <= 0 || entry.lineWidth < entry.lineBases)
+            error("Cannot load the indexed fasta.");
+        if (entry.length > 0 && locate(entry, entry.length - 1) >= data + size)
+            error("The FASTA index does not match the reference file.");
+        index[name] = entry;
+    }
+}
+
+int MappedFasta::sequenceLength(const string &chrom) const
+{
+    auto it = index.find(chrom);
+    return it == index.end() ? -1 : it->second.length;
+}
+
+SequenceView MappedFasta::view(const string &chrom, int begin, int end, string &buffer, bool &bGathered) const
+{
+    const IndexEntry& entry = index.at(chrom);
+    int length = end - begin + 1;
+    const char *p = locate(entry, begin);
+
+    if (begin / entry.lineBases == end / entry.lineBases
+            && none_of(p, p + length, [](char c) { return islower((unsigned char)c) != 0; })) {
+        bGathered = false;
+        return { p, length };
+    }
+
+    bGathered = true;
+    buffer.clear();
+    buffer.reserve(length);
+    for (int i = begin; i <= end; ) {
+        int n = min(end + 1, (i / entry.lineBases + 1) * entry.lineBases) - i;
+        const char *q = locate(entry, i);
+        for (int k = 0; k < n; ++k) buffer.push_back(toupper((unsigned char)q[k]));
+        i += n;
+    }
+    return { buffer.data(), length };
+}
@@ -0,0 +1,55 @@
+#ifndef MAPPEDFASTA_H
+#define MAPPEDFASTA_H
+
+#include <string>
+#include <unordered_map>
+
+// Bases of a reference fetch. The view is only valid until the next fetch
+// through the same FaidxWrapper.
+struct SequenceView
+{
+    const char *data;
+    int length;
+
+    std::string str() const { return std::string(data, length); }
+};
+
+// An uncompressed FASTA file mapped into memory. The position of every base
+// follows from the offset and line layout recorded in the .fai index, so a
+// fetch that lies on a single line of uppercase bases is returned as a view
+// into the mapping; anything else is gathered (and uppercased) into a buffer
+// supplied by the caller. The mapping is read-only and shared by all threads,
+// which all hit the same page cache.
+class MappedFasta
+{
+public:
+    MappedFasta(const std::string& fasta);
+    virtual ~MappedFasta();
+
+    // -1 if the sequence is not in the index
+    int sequenceLength(const std::string& chrom) const;
+
+    // Bases [begin, end] (0-based, inclusive) of a sequence, which must lie
+    // inside it. Sets bGathered if the bases had to be copied into buffer.
+    SequenceView view(const std::string& chrom, int begin, int end, std::string& buffer, bool& bGathered) const;
+
+private:
+    struct IndexEntry
+    {
+        int length;
+        long long offset;
+        int lineBases;
+        int lineWidth;
+    };
+
+    void loadIndex(const std::string& filename);
+    const char *locate(const IndexEntry& entry, int position) const {
+        return data + entry.offset + (long long)(position / entry.lineBases) * entry.lineWidth + position % entry.lineBases;
+    }
+
+    std::unordered_map<std::string, IndexEntry> index;
+    const char *data;
+    std::size_t size;
+};
+
+#endif // MAPPEDFASTA_H
@@ -0,0 +1,102 @@
+#include "PairSource.h"
+#include "error.h"
+
+using namespace std;
+using namespace BamTools;
+
+PairRecord PairRecord::fromAlignment(const BamAlignment &al)
+{
+    return { al.RefID, al.Position, al.GetEndPosition(), al.MateRefID, al.MatePosition,
+             al.IsReverseStrand(), al.IsMateReverseStrand(), al.MapQuality };
+}
+
+bool PairRecord::isCandidate() const
+{
+    return referenceId >= 0 && referenceId == mateReferenceId && bReverse != bMateReverse;
+}
+
+BamPairSource::BamPairSource(BamReader &reader)
+    : reader(reader)
+{
+}
+
+void BamPairSource::fetch(int referenceId, int left, int right, vector<PairRecord> &records)
+{
+    if (!reader.SetRegion(referenceId, left, referenceId, right))
+        error("Could not set the region.");
+
+    // Only the core fields are needed
+    BamAlignment al;
+    while (reader.GetNextAlignmentCore(al)) {
+        PairRecord record = PairRecord::fromAlignment(al);
+        if (record.isCandidate()) records.push_back(record);
+    }
+}
+
+PrefetchedPairSource::PrefetchedPairSource(const vector<PairRecord> &prefetched)
+    : prefetched(prefetched)
+{
+}
+
+void PrefetchedPairSource::fetch(int referenceId, int left, int right, vector<PairRecord> &records)
+{
+    for (auto &r: prefetched)
+        if (r.referenceId == referenceId && r.overlaps(left, right)) records.push_back(r);
+}
+
+WindowPairSource::WindowPairSource()
+    : buffer(1024), head(0), count(0), maxSpan(0)
+{
+}
+
+void WindowPairSource::add(const PairRecord &record)
+{
+    if (count == buffer.size()) {
+        vector<PairRecord> larger(buffer.size() * 2);
+        for (size_t i = 0; i < count; ++i)
+            larger[i] = at(i);
+        buffer.swap(larger);
+        head = 0;
+    }
+    buffer[(head + count) & (buffer.size() - 1)] = record;
+    count++;
+    if (record.endPosition - record.position > maxSpan)
+        maxSpan = record.endPosition - record.position;
+}
+
+void WindowPairSource::evict(int referenceId, int leftBound)
+{
+    while (count > 0) {
+        const PairRecord& r = at(0);
+        if (r.referenceId > referenceId ||
+                (r.referenceId == referenceId && r.position + maxSpan > leftBound))
+            break;
+        head = (head + 1) & (buffer.size() - 1);
+        count--;
+    }
+}
+
+void WindowPairSource::clear()
+{
+    head = count = 0;
+}
+
+void WindowPairSource::fetch(int referenceId, int left, int right, vector<PairRecord> &records)
+{
+    // Records are in coordinate order; find the first one that may reach left
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const PairRecord& r = at(mid);
+        if (r.referenceId < referenceId ||
+                (r.referenceId == referenceId && r.position + maxSpan <= left))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (size_t i = lo; i < count; ++i) {
+        const PairRecord& r = at(i);
+        if (r.referenceId != referenceId || r.position >= right) break;
+        if (r.overlaps(left, right)) records.push_back(r);
+    }
+}
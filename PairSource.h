@@ -0,0 +1,92 @@
+#ifndef PAIRSOURCE_H
+#define PAIRSOURCE_H
+
+#include "api/BamReader.h"
+#include <vector>
+
+// The parts of a BAM record needed to decide whether its pair spans a clip
+struct PairRecord
+{
+    int referenceId;
+    int position;       // 0-based
+    int endPosition;    // 0-based, exclusive
+    int mateReferenceId;
+    int matePosition;
+    bool bReverse;
+    bool bMateReverse;
+    int mapQuality;
+
+    static PairRecord fromAlignment(const BamTools::BamAlignment& al);
+
+    // Whether the pair could span some clip: both ends on the same reference
+    // in forward/reverse orientation
+    bool isCandidate() const;
+
+    // Same test as BamTools uses for the region [left, right)
+    bool overlaps(int left, int right) const {
+        return position < right && (position >= left || endPosition > left);
+    }
+};
+
+// Answers the spanning pair queries of the clips
+class PairSource
+{
+public:
+    virtual ~PairSource() {}
+
+    // Collect the records overlapping [left, right) of a reference (0-based)
+    virtual void fetch(int referenceId, int left, int right, std::vector<PairRecord>& records) = 0;
+};
+
+// Queries the indexed BAM file
+class BamPairSource : public PairSource
+{
+public:
+    BamPairSource(BamTools::BamReader& reader);
+
+    void fetch(int referenceId, int left, int right, std::vector<PairRecord>& records);
+
+private:
+    BamTools::BamReader& reader;
+};
+
+// Answers queries from records that were collected beforehand
+class PrefetchedPairSource : public PairSource
+{
+public:
+    PrefetchedPairSource(const std::vector<PairRecord>& prefetched);
+
+    void fetch(int referenceId, int left, int right, std::vector<PairRecord>& records);
+
+private:
+    const std::vector<PairRecord>& prefetched;
+};
+
+// Sliding window over the candidate records of a coordinate-sorted BAM
+// stream, kept in a ring buffer. Records are added as the stream is read and
+// dropped once no query can reach them any more.
+class WindowPairSource : public PairSource
+{
+public:
+    WindowPairSource();
+
+    void add(const PairRecord& record);
+    // Drop the records that end before leftBound on the reference, and all
+    // records on earlier references
+    void evict(int referenceId, int leftBound);
+    void clear();
+
+    std::size_t size() const { return count; }
+
+    void fetch(int referenceId, int left, int right, std::vector<PairRecord>& records);
+
+private:
+    const PairRecord& at(std::size_t i) const { return buffer[(head + i) & (buffer.size() - 1)]; }
+
+    std::vector<PairRecord> buffer;     // size is a power of two
+    std::size_t head;
+    std::size_t count;
+    int maxSpan;                        // longest record seen, bounds the look-back of a query
+};
+
+#endif // PAIRSOURCE_H
@@ -0,0 +1,220 @@
+#include "ParallelCaller.h"
+#include "ClipBatcher.h"
+#include "error.h"
+#include "Thirdparty/Timer.h"
+#include "Thirdparty/overlapper_simd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <thread>
+
+using namespace std;
+
+// Number of entries in each queue between the pipeline stages
+static const size_t QUEUE_CAPACITY = 4096;
+
+ParallelCaller::ParallelCaller(const string &bamFile, const string &refFile, const CallParams &params,
+                               int numThreads, size_t cacheSize, ReferenceMode referenceMode)
+    : bamFile(bamFile), pAligner(params.pAligner), cache(cacheSize), pResident(NULL), pMapped(NULL)
+{
+    if (referenceMode == REFERENCE_RESIDENT) pResident = new ResidentReference(refFile);
+    if (referenceMode == REFERENCE_MAPPED) pMapped = new MappedFasta(refFile);
+    if (numThreads < 1) numThreads = 1;
+    for (int i = 0; i < numThreads; ++i)
+        callers.push_back(new ClipCaller(bamFile, refFile, params, &cache, pResident, pMapped));
+}
+
+ParallelCaller::~ParallelCaller()
+{
+    for (auto pCaller: callers) delete pCaller;
+    delete pResident;
+    delete pMapped;
+}
+
+void ParallelCaller::run(ClipReader &creader, DeletionWriter &writer)
+{
+    BoundedQueue<ClipTask> clips(QUEUE_CAPACITY);
+    BoundedQueue<CallResult> results(QUEUE_CAPACITY);
+
+    thread extractor(&ParallelCaller::extract, this, &creader, &clips);
+    vector<thread> workers;
+    for (auto pCaller: callers)
+        workers.push_back(thread(&ParallelCaller::work, this, pCaller, &clips, &results));
+
+    write(&results, &writer);
+
+    extractor.join();
+    for (auto &t: workers) t.join();
+
+    clips.printStats("clips");
+    results.printStats("results");
+    printStats();
+}
+
+void ParallelCaller::extract(ClipReader *pReader, BoundedQueue<ClipTask> *pClips)
+{
+    ClipBatcher batcher(*pReader);
+    size_t index = 0;
+    vector<AbstractClip*> batch;
+    while (batcher.next(batch))
+        pClips->push({index++, new vector<AbstractClip*>(batch)});
+    for (size_t i = 0; i < callers.size(); ++i)
+        pClips->push({index, NULL});
+}
+
+void ParallelCaller::work(ClipCaller *pCaller, BoundedQueue<ClipTask> *pClips, BoundedQueue<CallResult> *pResults)
+{
+    ClipTask task;
+    while (true) {
+        pClips->pop(task);
+        CallResult result;
+        result.index = task.index;
+        result.bLast = (task.pBatch == NULL);
+        if (result.bLast) {
+            pResults->push(result);
+            break;
+        }
+        result.referenceId = task.pBatch->front()->getReferenceId();
+        pCaller->call(*task.pBatch, result.deletions);
+        for (auto pClip: *task.pBatch) delete pClip;
+        delete task.pBatch;
+        pResults->push(result);
+    }
+}
+
+void ParallelCaller::write(BoundedQueue<CallResult> *pResults, DeletionWriter *pWriter)
+{
+    // Results arrive in any order; hold them back until all earlier batches are in
+    map<size_t, CallResult> pending;
+    size_t nextIndex = 0;
+    size_t numStopped = 0;
+    int referenceId = -1;
+
+    CallResult result;
+    while (numStopped < callers.size()) {
+        pResults->pop(result);
+        if (result.bLast) {
+            numStopped++;
+            continue;
+        }
+        pending[result.index].deletions.swap(result.deletions);
+        pending[result.index].referenceId = result.referenceId;
+
+        map<size_t, CallResult>::iterator it;
+        while ((it = pending.begin()) != pending.end() && it->first == nextIndex) {
+            // The BAM file is sorted, so a new reference completes all earlier ones
+            if (it->second.referenceId > referenceId) {
+                referenceId = it->second.referenceId;
+                pWriter->finishReferencesBefore(referenceId);
+            }
+            for (auto &d: it->second.deletions)
+                pWriter->add(it->second.referenceId, d);
+            pending.erase(it);
+            nextIndex++;
+        }
+    }
+}
+
+void ParallelCaller::run(ClipReader &creader, const vector<Shard> &shards, DeletionWriter &writer)
+{
+    vector<vector<Deletion> > results(shards.size());
+    vector<double> costs;
+    estimateShardCosts(bamFile, shards, costs);
+    // A resident chromosome is shared only by threads calling it together
+    TileScheduler scheduler(costs, callers.size(), pResident != NULL);
+
+    if (callers.size() == 1) {
+        workOnShards(0, &creader, &scheduler, &shards, &results);
+    } else {
+        Timer timer("Calling shards", true);
+        vector<ClipReader*> readers;
+        vector<thread> workers;
+        for (size_t i = 0; i < callers.size(); ++i) {
+            readers.push_back(creader.clone());
+            workers.push_back(thread(&ParallelCaller::workOnShards, this, i, readers[i], &scheduler, &shards, &results));
+        }
+        for (auto &t: workers) t.join();
+        for (auto pReader: readers) delete pReader;
+        scheduler.printStats(timer.getElapsedWallTime());
+    }
+    printStats();
+
+    // Shards are laid out in genome order
+    for (size_t i = 0; i < shards.size(); ++i) {
+        writer.finishReferencesBefore(shards[i].referenceId);
+        for (auto &d: results[i])
+            writer.add(shards[i].referenceId, d);
+    }
+}
+
+void ParallelCaller::workOnShards(int threadId, ClipReader *pReader, TileScheduler *pScheduler,
+                                  const vector<Shard> *pShards, vector<vector<Deletion> > *pResults)
+{
+    ClipCaller *pCaller = callers[threadId];
+    size_t index;
+    while (true) {
+        if (pResident != NULL) {
+            // Take the tile and its chromosome together, so that a chromosome
+            // stays held from its first tile until its last one is taken and
+            // is loaded only once
+            lock_guard<mutex> lock(residentMutex);
+            if (!pScheduler->next(threadId, index)) break;
+            try {
+                pCaller->holdReference(pReader->getReferenceName((*pShards)[index].referenceId));
+            } catch (ErrorException& ex) {
+                // The fetches of the tile fail again and mark its clips CLIP_ERROR
+            }
+        } else if (!pScheduler->next(threadId, index)) {
+            break;
+        }
+        Timer timer("Calling a shard", true);
+        if (pReader->setShard((*pShards)[index])) {
+            ClipBatcher batcher(*pReader);
+            vector<AbstractClip*> batch;
+            while (batcher.next(batch)) {
+                pCaller->call(batch, (*pResults)[index]);
+                for (auto pClip: batch) delete pClip;
+            }
+        }
+        pScheduler->addBusyTime(threadId, timer.getElapsedWallTime());
+    }
+    pCaller->releaseReference();
+}
+
+void ParallelCaller::printStats() const
+{
+    size_t numClips = 0, numBatches = 0, numShared = 0, numSeedWindows = 0;
+    size_t numFetches = 0, numHits = 0, numBlocks = 0, numReadAhead = 0, bytesRead = 0, numGathered = 0;
+    for (auto pCaller: callers) {
+        numClips += pCaller->getNumClips();
+        numBatches += pCaller->getNumBatches();
+        numShared += pCaller->getNumSharedRegions();
+        numSeedWindows += pCaller->getNumSeedWindows();
+        const FaidxWrapper& faidx = pCaller->getFaidx();
+        numFetches += faidx.getNumFetches();
+        numHits += faidx.getNumHits();
+        numBlocks += faidx.getNumBlocksRead();
+        numReadAhead += faidx.getNumReadAhead();
+        bytesRead += faidx.getBytesRead();
+        numGathered += faidx.getNumGathered();
+    }
+    fprintf(stderr, "[batching] clips: %zu batches: %zu mean batch size: %.2lf shared target regions: %zu seed windows: %zu\n",
+            numClips, numBatches, numBatches ? (double)numClips / numBatches : 0.0, numShared, numSeedWindows);
+    size_t cells = OverlapperSIMD::getTotalCells(), skipped = OverlapperSIMD::getSkippedCells();
+    fprintf(stderr, "[alignment] simd: %s workspace allocations: %zu cells: %zu skipped: %zu (%.2lf%%)\n",
+            OverlapperSIMD::levelName(OverlapperSIMD::level()), AlignmentWorkspace::getTotalAllocations(),
+            cells, skipped, cells ? 100.0 * skipped / cells : 0.0);
+    (pAligner != NULL ? *pAligner : Aligner::defaultAligner()).printStats();
+    AbstractClip::printPrefilterStats();
+    AbstractClip::printStatusStats();
+    cache.printStats();
+    if (pResident != NULL)
+        pResident->printStats();
+    else if (pMapped != NULL)
+        fprintf(stderr, "[mapped reference] fetches: %zu zero-copy: %zu gathered: %zu\n",
+                numFetches, numFetches - numGathered, numGathered);
+    else
+        fprintf(stderr, "[reference cache] fetches: %zu hit rate: %.2lf%% blocks read: %zu read ahead: %zu bytes read: %zu\n",
+            numFetches, numFetches ? 100.0 * numHits / numFetches : 0.0, numBlocks, numReadAhead, bytesRead);
+}
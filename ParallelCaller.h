@@ -0,0 +1,76 @@
+#ifndef PARALLELCALLER_H
+#define PARALLELCALLER_H
+
+#include "AlignmentCache.h"
+#include "BoundedQueue.h"
+#include "ClipCaller.h"
+#include "ClipReader.h"
+#include "DeletionWriter.h"
+#include "MappedFasta.h"
+#include "ResidentReference.h"
+#include "TileScheduler.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Calls the clips of a ClipReader with a pool of worker threads, each owning a
+// ClipCaller. Clips are handed out in batches of nearby clips (see
+// ClipBatcher). By default the work runs as a three-stage pipeline: one thread
+// extracts batches, the workers call them, and the calling thread puts the
+// results back into clip order and streams them to the DeletionWriter. The
+// stages are connected by bounded lock-free queues.
+// Alternatively the work can be split into shards, each of which is read and
+// called by a single worker with its own ClipReader. Shards are handed out by
+// a TileScheduler seeded with their estimated costs, or in genome order when
+// the reference is resident.
+// Either way the output does not depend on the number of threads.
+class ParallelCaller
+{
+public:
+    enum ReferenceMode { REFERENCE_FAIDX, REFERENCE_RESIDENT, REFERENCE_MAPPED };
+
+    // cacheSize is the number of alignment results shared by the workers;
+    // the reference is read through faidx by each worker, decoded from packed
+    // chromosomes held in memory, or read from a shared mapping of the file
+    ParallelCaller(const std::string& bamFile, const std::string& refFile, const CallParams& params,
+                   int numThreads, std::size_t cacheSize, ReferenceMode referenceMode = REFERENCE_FAIDX);
+    virtual ~ParallelCaller();
+
+    void run(ClipReader& creader, DeletionWriter& writer);
+    void run(ClipReader& creader, const std::vector<Shard>& shards, DeletionWriter& writer);
+
+private:
+    struct ClipTask
+    {
+        std::size_t index;
+        std::vector<AbstractClip*> *pBatch;     // NULL tells a worker to stop
+    };
+
+    struct CallResult
+    {
+        std::size_t index;
+        int referenceId;
+        bool bLast;             // the worker has stopped
+        std::vector<Deletion> deletions;
+    };
+
+    void extract(ClipReader *pReader, BoundedQueue<ClipTask> *pClips);
+    void work(ClipCaller *pCaller, BoundedQueue<ClipTask> *pClips, BoundedQueue<CallResult> *pResults);
+    void write(BoundedQueue<CallResult> *pResults, DeletionWriter *pWriter);
+
+    void workOnShards(int threadId, ClipReader *pReader, TileScheduler *pScheduler,
+                      const std::vector<Shard> *pShards, std::vector<std::vector<Deletion> > *pResults);
+
+    void printStats() const;
+
+    std::string bamFile;
+    const Aligner *pAligner;
+    AlignmentCache cache;
+    ResidentReference *pResident;
+    std::mutex residentMutex;
+    MappedFasta *pMapped;
+    std::vector<ClipCaller*> callers;
+};
+
+#endif // PARALLELCALLER_H
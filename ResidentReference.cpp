@@ -0,0 +1,113 @@
+#include "ResidentReference.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// Bases read from the file at a time while packing
+static const int LOAD_CHUNK = 1 << 20;
+
+PackedSequence::PackedSequence(faidx_t *fai, const string &chrom)
+    : len(0)
+{
+    int length = faidx_seq_len(fai, chrom.c_str());
+    if (length < 0) error("cannot fetch the reference sequence");
+    bases.reserve((length + 3) / 4);
+    nMask.reserve((length + 63) / 64);
+
+    for (int begin = 0; begin < length; begin += LOAD_CHUNK) {
+        int n;
+        char *s = faidx_fetch_seq(fai, (char *)chrom.c_str(), begin, min(begin + LOAD_CHUNK, length) - 1, &n);
+        if (s == NULL) error("cannot fetch the reference sequence");
+        for (int i = 0; i < n; ++i) append(s[i]);
+        free(s);
+    }
+}
+
+void PackedSequence::append(char c)
+{
+    if (len % 4 == 0) bases.push_back(0);
+    if (len % 64 == 0) nMask.push_back(0);
+
+    uint8_t code = 0;
+    switch (toupper(c)) {
+    case 'A': code = 0; break;
+    case 'C': code = 1; break;
+    case 'G': code = 2; break;
+    case 'T': code = 3; break;
+    case 'N': nMask.back() |= (uint64_t)1 << (len % 64); break;
+    default: others.push_back(make_pair(len, (char)toupper(c))); break;
+    }
+    bases.back() |= code << (2 * (len % 4));
+    len++;
+}
+
+void PackedSequence::decode(int begin, int end, string &out) const
+{
+    static const char ALPHABET[] = "ACGT";
+    size_t offset = out.size();
+    for (int i = begin; i <= end; ++i) {
+        if (nMask[i / 64] >> (i % 64) & 1) out.push_back('N');
+        else out.push_back(ALPHABET[bases[i / 4] >> (2 * (i % 4)) & 3]);
+    }
+    auto it = lower_bound(others.begin(), others.end(), make_pair(begin, '\0'));
+    for (; it != others.end() && it->first <= end; ++it)
+        out[offset + it->first - begin] = it->second;
+}
+
+size_t PackedSequence::memoryUsage() const
+{
+    return bases.capacity() + nMask.capacity() * sizeof(uint64_t)
+            + others.capacity() * sizeof(pair<int, char>);
+}
+
+ResidentReference::ResidentReference(const string &fasta)
+    : numLoads(0), loadTime(0), residentBytes(0), peakBytes(0)
+{
+    fai = fai_load(fasta.c_str());
+    if (fai == NULL) error("Cannot load the indexed fasta.");
+}
+
+ResidentReference::~ResidentReference()
+{
+    if (fai != NULL) fai_destroy(fai);
+}
+
+shared_ptr<const PackedSequence> ResidentReference::acquire(const string &chrom)
+{
+    lock_guard<std::mutex> lock(mutex);
+    shared_ptr<const PackedSequence> pSequence = sequences[chrom].lock();
+    if (pSequence) return pSequence;
+
+    auto start = chrono::steady_clock::now();
+    PackedSequence *pLoaded = new PackedSequence(fai, chrom);
+    loadTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    numLoads++;
+    residentBytes += pLoaded->memoryUsage();
+    peakBytes = max(peakBytes, residentBytes);
+
+    pSequence.reset(pLoaded, [this](PackedSequence *p) { release(p); });
+    sequences[chrom] = pSequence;
+    return pSequence;
+}
+
+void ResidentReference::release(PackedSequence *pSequence)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        residentBytes -= pSequence->memoryUsage();
+    }
+    delete pSequence;
+}
+
+void ResidentReference::printStats() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    fprintf(stderr, "[resident reference] chromosomes loaded: %zu load time: %.2lfs peak memory: %.1lf MB\n",
+            numLoads, loadTime, peakBytes / 1048576.0);
+}
@@ -0,0 +1,67 @@
+#ifndef RESIDENTREFERENCE_H
+#define RESIDENTREFERENCE_H
+
+#include "htslib/faidx.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A whole chromosome, uppercased and packed into 2 bits per base. Ns are kept
+// in a separate bit mask and the few other IUPAC codes in a sorted list.
+class PackedSequence
+{
+public:
+    PackedSequence(faidx_t *fai, const std::string& chrom);
+
+    int length() const { return len; }
+    // Append bases [begin, end] (0-based, inclusive) to out
+    void decode(int begin, int end, std::string& out) const;
+    std::size_t memoryUsage() const;
+
+private:
+    void append(char c);
+
+    int len;
+    std::vector<uint8_t> bases;         // four bases per byte
+    std::vector<uint64_t> nMask;
+    std::vector<std::pair<int, char> > others;
+};
+
+// Keeps the chromosomes that the worker threads are calling in memory. A
+// chromosome is loaded by the first thread that enters it and freed once the
+// last thread has moved on. Each thread holds at most one chromosome; in the
+// pipeline, where all threads follow the clip stream, that means a chromosome
+// and its successor at most. With shards, tiles are handed out in genome order
+// and a thread holds the chromosome of a tile from the moment it takes it, so
+// each chromosome is still loaded once. The chromosomes in memory are those of
+// the tiles being called: at most one per thread, and usually one or two, as
+// those tiles are neighbours in the genome.
+class ResidentReference
+{
+public:
+    ResidentReference(const std::string& fasta);
+    virtual ~ResidentReference();
+
+    std::shared_ptr<const PackedSequence> acquire(const std::string& chrom);
+
+    void printStats() const;
+
+private:
+    void release(PackedSequence *pSequence);
+
+    faidx_t *fai;
+    mutable std::mutex mutex;
+    std::map<std::string, std::weak_ptr<const PackedSequence> > sequences;
+
+    std::size_t numLoads;
+    double loadTime;
+    std::size_t residentBytes;
+    std::size_t peakBytes;
+};
+
+#endif // RESIDENTREFERENCE_H
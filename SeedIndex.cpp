@@ -0,0 +1,74 @@
+#include "SeedIndex.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// The 2-bit code of a base, or -1 if it is not one of ACGT
+static inline int baseCode(char c)
+{
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+}
+
+// Call f(offset, code) for every k-mer of s made of ACGT only
+template<class F>
+static void forEachKmer(const char *s, int n, int k, F f)
+{
+    const uint32_t mask = k == 16 ? 0xffffffffu : (1u << (2 * k)) - 1;
+    uint32_t code = 0;
+    int valid = 0;
+    for (int i = 0; i < n; ++i) {
+        int c = baseCode(s[i]);
+        if (c < 0) {
+            valid = 0;
+            continue;
+        }
+        code = ((code << 2) | c) & mask;
+        if (++valid >= k) f(i - k + 1, code);
+    }
+}
+
+SeedIndex::SeedIndex(const string &referenceName, int start, const string &sequence, int k)
+    : referenceName(referenceName), start(start), sequence(sequence), k(max(1, min(k, MAX_K)))
+{
+    int bits = 1;
+    while (bits < 30 && (1u << bits) < sequence.size()) bits++;
+    shift = 32 - bits;
+    buckets.assign((1u << bits) + 1, 0);
+
+    // Count the k-mers of each bucket, then place them
+    forEachKmer(sequence.data(), sequence.size(), this->k, [this](int, uint32_t code) { buckets[bucketOf(code) + 1]++; });
+    for (size_t b = 1; b < buckets.size(); ++b) buckets[b] += buckets[b - 1];
+    entries.resize(buckets.back());
+    vector<uint32_t> next(buckets.begin(), buckets.end() - 1);
+    forEachKmer(sequence.data(), sequence.size(), this->k, [this, &next, start](int offset, uint32_t code) {
+        entries[next[bucketOf(code)]++] = Entry{ code, start + offset };
+    });
+}
+
+SeedIndex::~SeedIndex()
+{
+}
+
+bool SeedIndex::covers(const string &referenceName, int start, int end) const
+{
+    return referenceName == this->referenceName && start >= this->start && start <= end
+           && end < this->start + (int)sequence.size();
+}
+
+void SeedIndex::lookup(const char *s, int n, int start, int end, vector<pair<int, int> > &hits) const
+{
+    forEachKmer(s, n, k, [this, start, end, &hits](int offset, uint32_t code) {
+        size_t b = bucketOf(code);
+        for (uint32_t e = buckets[b]; e < buckets[b + 1]; ++e) {
+            if (entries[e].code == code && entries[e].position >= start && entries[e].position + k - 1 <= end)
+                hits.push_back(make_pair(entries[e].position, offset));
+        }
+    });
+}
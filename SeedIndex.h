@@ -0,0 +1,51 @@
+#ifndef SEEDINDEX_H
+#define SEEDINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Index of the k-mers of one window of a reference sequence. The clips of a
+// batch look for their overlaps in target regions that mostly fall into the
+// same window, so the window is fetched and indexed once and every clip looks
+// up its seeds in it. K-mers are hashed into buckets laid out one after the
+// other; k-mers with bases other than ACGT are left out.
+class SeedIndex
+{
+public:
+    static const int MAX_K = 16;
+
+    // Index sequence, the bases from start (1-based) of referenceName on
+    SeedIndex(const std::string& referenceName, int start, const std::string& sequence, int k);
+    virtual ~SeedIndex();
+
+    int getK() const { return k; }
+
+    // True if bases start to end (1-based, inclusive) of referenceName are in the window
+    bool covers(const std::string& referenceName, int start, int end) const;
+    // The bases of the window from start (1-based) on
+    const char *data(int start) const { return sequence.data() + (start - this->start); }
+
+    // Append the positions (1-based) of the k-mers of s that occur within
+    // bases start to end, each with the offset of the k-mer in s
+    void lookup(const char *s, int n, int start, int end, std::vector<std::pair<int, int> >& hits) const;
+
+private:
+    struct Entry
+    {
+        uint32_t code;
+        int position;
+    };
+
+    std::size_t bucketOf(uint32_t code) const { return (code * 2654435761u) >> shift; }
+
+    std::string referenceName;
+    int start;
+    std::string sequence;
+    int k;
+    int shift;
+    std::vector<uint32_t> buckets;      // the first entry of each bucket, and the end of the last
+    std::vector<Entry> entries;
+};
+
+#endif // SEEDINDEX_H
@@ -0,0 +1,147 @@
+#include "Shard.h"
+#include "Helper.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+using namespace std;
+
+int Shard::flankedStart() const
+{
+    return max(1, start - flank);
+}
+
+int Shard::flankedEnd() const
+{
+    return end + flank;
+}
+
+bool Shard::owns(int position) const
+{
+    return position >= start && position <= end;
+}
+
+static bool parsePosition(string str, int& pos)
+{
+    str.erase(remove(str.begin(), str.end(), ','), str.end());
+    if (str.empty()) return false;
+    char *endp;
+    long val = strtol(str.c_str(), &endp, 10);
+    if (*endp != '\0' || val < 1) return false;
+    pos = val;
+    return true;
+}
+
+bool parseRegion(const string &str, string &referenceName, int &start, int &end)
+{
+    start = end = 0;
+    size_t colon = str.find_last_of(':');
+    if (colon == string::npos) {
+        referenceName = str;
+        return !referenceName.empty();
+    }
+    referenceName = str.substr(0, colon);
+    if (referenceName.empty()) return false;
+
+    string range = str.substr(colon + 1);
+    size_t dash = range.find('-');
+    if (!parsePosition(range.substr(0, dash), start)) return false;
+    if (dash != string::npos && !parsePosition(range.substr(dash + 1), end)) return false;
+    return end == 0 || start <= end;
+}
+
+void tileRegion(int referenceId, int start, int end, int tileSize, int flank, vector<Shard> &shards)
+{
+    if (tileSize <= 0) tileSize = end - start + 1;
+    for (int s = start; s <= end; s += tileSize) {
+        int e = min(end, s + tileSize - 1);
+        shards.push_back({referenceId, s, e, flank});
+        if (e == end) break;
+    }
+}
+
+// Each entry of the BAI linear index covers 2^14 bases
+static const int LINEAR_INDEX_SHIFT = 14;
+
+struct LinearIndex
+{
+    std::vector<uint64_t> offsets;
+    uint64_t lastOffset;
+};
+
+template<class T>
+static bool readValue(ifstream& in, T& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return in.good();
+}
+
+static bool loadLinearIndexes(const string& bamFile, vector<LinearIndex>& indexes)
+{
+    ifstream in((bamFile + ".bai").c_str(), ios::binary);
+    if (!in) in.open((stripExtension(bamFile) + ".bai").c_str(), ios::binary);
+    if (!in) return false;
+
+    char magic[4];
+    in.read(magic, 4);
+    if (!in.good() || memcmp(magic, "BAI\1", 4) != 0) return false;
+
+    int32_t numRefs;
+    if (!readValue(in, numRefs) || numRefs < 0) return false;
+    indexes.resize(numRefs);
+
+    for (int32_t r = 0; r < numRefs; ++r) {
+        LinearIndex& index = indexes[r];
+        index.lastOffset = 0;
+
+        int32_t numBins;
+        if (!readValue(in, numBins)) return false;
+        for (int32_t b = 0; b < numBins; ++b) {
+            uint32_t bin;
+            int32_t numChunks;
+            if (!readValue(in, bin) || !readValue(in, numChunks)) return false;
+            for (int32_t c = 0; c < numChunks; ++c) {
+                uint64_t chunkBeg, chunkEnd;
+                if (!readValue(in, chunkBeg) || !readValue(in, chunkEnd)) return false;
+                index.lastOffset = max(index.lastOffset, chunkEnd);
+            }
+        }
+
+        int32_t numIntervals;
+        if (!readValue(in, numIntervals) || numIntervals < 0) return false;
+        index.offsets.resize(numIntervals);
+        for (int32_t i = 0; i < numIntervals; ++i)
+            if (!readValue(in, index.offsets[i])) return false;
+    }
+    return true;
+}
+
+// Compressed file offset of the first record at or after the given window
+static uint64_t fileOffset(const LinearIndex& index, size_t window)
+{
+    for (; window < index.offsets.size(); ++window)
+        if (index.offsets[window] != 0) return index.offsets[window] >> 16;
+    return index.lastOffset >> 16;
+}
+
+void estimateShardCosts(const string &bamFile, const vector<Shard> &shards, vector<double> &costs)
+{
+    vector<LinearIndex> indexes;
+    bool bIndexed = loadLinearIndexes(bamFile, indexes);
+
+    costs.clear();
+    for (auto &shard: shards) {
+        double length = shard.flankedEnd() - shard.flankedStart() + 1;
+        if (!bIndexed || shard.referenceId >= (int)indexes.size()) {
+            costs.push_back(length);
+            continue;
+        }
+        const LinearIndex& index = indexes[shard.referenceId];
+        uint64_t first = fileOffset(index, (shard.flankedStart() - 1) >> LINEAR_INDEX_SHIFT);
+        uint64_t last = fileOffset(index, ((shard.flankedEnd() - 1) >> LINEAR_INDEX_SHIFT) + 1);
+        // Keep empty shards ordered by length
+        costs.push_back((last > first ? last - first : 0) + length / (1 << LINEAR_INDEX_SHIFT));
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <string>
+#include <vector>
+
+// A piece of the genome that is called independently of the others. Reads are
+// taken from the shard extended by a flank on both sides, but only the clips
+// whose clip position falls inside [start, end] belong to the shard, so
+// neighbouring shards never call the same clip twice.
+struct Shard
+{
+    int referenceId;
+    int start;  // 1-based, inclusive
+    int end;
+    int flank;
+
+    int flankedStart() const;
+    int flankedEnd() const;
+    bool owns(int position) const;
+};
+
+// Parse a region given as chr, chr:start or chr:start-end (1-based, inclusive).
+// Missing bounds are returned as 0.
+bool parseRegion(const std::string& str, std::string& referenceName, int& start, int& end);
+
+// Split [start, end] of a reference into consecutive shards of at most tileSize
+// bases. A non-positive tileSize yields a single shard.
+void tileRegion(int referenceId, int start, int end, int tileSize, int flank, std::vector<Shard>& shards);
+
+// Estimate the work in each shard as the number of compressed BAM bytes its
+// flanked span covers, read from the linear index of the .bai file. Falls
+// back to the flanked length of the shard when no .bai can be read.
+void estimateShardCosts(const std::string& bamFile, const std::vector<Shard>& shards, std::vector<double>& costs);
+
+#endif // SHARD_H
@@ -23,6 +23,7 @@
 // SOFTWARE.
 // ------------------------------------------------------------------------------
 #include "overlapper.h"
+#include "overlapper_simd.h"
 #include "../error.h"
 #include <assert.h>
 #include <vector>
@@ -34,8 +35,9 @@
 #include <stdio.h>
 #include <numeric>
 
-OverlapperParams default_params = { 2, -6, -3 };
-OverlapperParams ungapped_params = { 2, -10000, -3 };
+OverlapperParams default_params = { DefaultParams::match_score, DefaultParams::gap_penalty, DefaultParams::mismatch_penalty };
+OverlapperParams ungapped_params = { UngappedParams::match_score, UngappedParams::gap_penalty, UngappedParams::mismatch_penalty };
+OverlapperParams svseq2_params = { Svseq2Params::match_score, Svseq2Params::gap_penalty, Svseq2Params::mismatch_penalty };
 
 
 
@@ -254,11 +256,9 @@ void SequenceOverlap::printAlignment(const std::string& s1, const std::string& s
     printf("Identity: %2.2lf\n", getPercentIdentity());
 }
 
-typedef std::vector<int> DPCells;
-typedef std::vector<DPCells> DPMatrix;
-
 //
-SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params)
+template<class Params>
+static SequenceOverlap computeOverlapKernel(const std::string& s1, const std::string& s2, const Params& params, AlignmentWorkspace& workspace)
 {
     // Exit with invalid intervals if either string is zero length
     SequenceOverlap output;
@@ -271,10 +271,7 @@ SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::str
     size_t num_columns = s1.size() + 1;
     size_t num_rows = s2.size() + 1;
 
-    DPMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
+    DPView<int> score_matrix = workspace.matrix<int>(0, num_columns, num_rows);
 
     // Calculate scores
     for(size_t i = 1; i < num_columns; ++i) {
@@ -345,7 +342,8 @@ SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::str
     output.edit_distance = 0;
     output.total_columns = 0;
 
-    std::string cigar;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
     while(i > 0 && j > 0) {
         // Compute the possible previous locations of the path
         int idx_1 = i - 1;
@@ -388,11 +386,29 @@ SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::str
     // The backtracking produces a cigar string in reversed order, flip it
     std::reverse(cigar.begin(), cigar.end());
     assert(!cigar.empty());
-    output.cigar = compactCigar(cigar);
+    output.cigar = Overlapper::compactCigar(cigar);
     return output;
 }
 
-SequenceOverlap Overlapper::computeOverlapSG(const std::string& s1, const std::string& s2, const OverlapperParams params)
+struct ComputeOverlapCall
+{
+    typedef SequenceOverlap result_type;
+    const std::string& s1;
+    const std::string& s2;
+    AlignmentWorkspace& workspace;
+
+    template<class Params>
+    SequenceOverlap operator()(const Params& params) const { return computeOverlapKernel(s1, s2, params, workspace); }
+};
+
+SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    ComputeOverlapCall kernel = { s1, s2, workspace };
+    return dispatchParams(params, kernel);
+}
+
+template<class Params>
+static SequenceOverlap computeOverlapSGKernel(const std::string& s1, const std::string& s2, const Params& params, AlignmentWorkspace& workspace)
 {
     // Exit with invalid intervals if either string is zero length
     SequenceOverlap output;
@@ -405,10 +421,7 @@ SequenceOverlap Overlapper::computeOverlapSG(const std::string& s1, const std::s
     size_t num_columns = s1.size() + 1;
     size_t num_rows = s2.size() + 1;
 
-    DPMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
+    DPView<int> score_matrix = workspace.matrix<int>(0, num_columns, num_rows);
 
     for(size_t j = 0; j < num_rows; ++j) {
         score_matrix[0][j] = j*params.gap_penalty;
@@ -460,7 +473,8 @@ SequenceOverlap Overlapper::computeOverlapSG(const std::string& s1, const std::s
     output.edit_distance = 0;
     output.total_columns = 0;
 
-    std::string cigar;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
     while(j > 0 && i > 0) {
         // Compute the possible previous locations of the path
         int idx_1 = i - 1;
@@ -504,11 +518,29 @@ SequenceOverlap Overlapper::computeOverlapSG(const std::string& s1, const std::s
     // The backtracking produces a cigar string in reversed order, flip it
     std::reverse(cigar.begin(), cigar.end());
     assert(!cigar.empty());
-    output.cigar = compactCigar(cigar);
+    output.cigar = Overlapper::compactCigar(cigar);
     return output;
 }
 
-SequenceOverlap Overlapper::alignSuffix(const std::string& s1, const std::string& s2, const OverlapperParams params)
+struct ComputeOverlapSGCall
+{
+    typedef SequenceOverlap result_type;
+    const std::string& s1;
+    const std::string& s2;
+    AlignmentWorkspace& workspace;
+
+    template<class Params>
+    SequenceOverlap operator()(const Params& params) const { return computeOverlapSGKernel(s1, s2, params, workspace); }
+};
+
+SequenceOverlap Overlapper::computeOverlapSG(const std::string& s1, const std::string& s2, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    ComputeOverlapSGCall kernel = { s1, s2, workspace };
+    return dispatchParams(params, kernel);
+}
+
+template<class Params>
+static SequenceOverlap alignSuffixKernel(const std::string& s1, const std::string& s2, const Params& params, AlignmentWorkspace& workspace)
 {
     // Exit with invalid intervals if either string is zero length
     SequenceOverlap output;
@@ -521,10 +553,7 @@ SequenceOverlap Overlapper::alignSuffix(const std::string& s1, const std::string
     size_t num_columns = s1.size() + 1;
     size_t num_rows = s2.size() + 1;
 
-    DPMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
+    DPView<int> score_matrix = workspace.matrix<int>(0, num_columns, num_rows);
 
     // Calculate scores
     for(size_t i = 1; i < num_columns; ++i) {
@@ -571,7 +600,8 @@ SequenceOverlap Overlapper::alignSuffix(const std::string& s1, const std::string
     output.edit_distance = 0;
     output.total_columns = 0;
 
-    std::string cigar;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
     while(i > 0 && j > 0 && score_matrix[i][j] > 0) {
         // Compute the possible previous locations of the path
         int idx_1 = i - 1;
@@ -614,71 +644,112 @@ SequenceOverlap Overlapper::alignSuffix(const std::string& s1, const std::string
     // The backtracking produces a cigar string in reversed order, flip it
     std::reverse(cigar.begin(), cigar.end());
     assert(!cigar.empty());
-    output.cigar = compactCigar(cigar);
+    output.cigar = Overlapper::compactCigar(cigar);
     return output;
 }
 
-SequenceOverlap Overlapper::computeOverlapSW2(const std::string& s1, const std::string& s2, int minOverlap, double minIdentity, const OverlapperParams params)
+struct AlignSuffixCall
 {
-    // Exit with invalid intervals if either string is zero length
-    SequenceOverlap output;
-    if(s1.empty() || s2.empty()) {
-        std::cerr << "Overlapper::computeOverlapSW error: empty input sequence\n";
-        exit(EXIT_FAILURE);
-    }
+    typedef SequenceOverlap result_type;
+    const std::string& s1;
+    const std::string& s2;
+    AlignmentWorkspace& workspace;
 
-    // Initialize the scoring matrix
-    size_t num_columns = s1.size() + 1;
-    size_t num_rows = s2.size() + 1;
+    template<class Params>
+    SequenceOverlap operator()(const Params& params) const { return alignSuffixKernel(s1, s2, params, workspace); }
+};
 
-    DPMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
+SequenceOverlap Overlapper::alignSuffix(const std::string& s1, const std::string& s2, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    AlignSuffixCall kernel = { s1, s2, workspace };
+    return dispatchParams(params, kernel);
+}
 
-    // Calculate scores
-    for(size_t i = 1; i < num_columns; ++i) {
-        for(size_t j = 1; j < num_rows; ++j) {
-            // Calculate the score for entry (i,j)
-            int idx_1 = i - 1;
-            int idx_2 = j - 1;
-            int diagonal = score_matrix[i-1][j-1] + (s1[idx_1] == s2[idx_2] ? params.match_score : params.mismatch_penalty);
-            int up = score_matrix[i][j-1] + params.gap_penalty;
-//            int gap_pen = (j == num_rows - 1) ? 0 : params.gap_penalty;
-//            int left = score_matrix[i-1][j] + gap_pen;
-            int left = score_matrix[i-1][j] + params.gap_penalty;
+SequenceOverlap Overlapper::computeOverlapSW2(const std::string& s1, const std::string& s2, int minOverlap, double minIdentity, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    return computeOverlapSW2(s1.data(), s1.size(), s2.data(), s2.size(), minOverlap, minIdentity, params, workspace);
+}
 
-            score_matrix[i][j] = std::max(0, max3(diagonal, up, left));
+void Overlapper::selectEndpoints(const std::vector<int>& last_row, size_t k, std::vector<size_t>& endpoints)
+{
+    // Bounded heap whose top is the worst endpoint kept
+    auto better = [&last_row](size_t i1, size_t i2) {
+        return last_row[i1] > last_row[i2] || (last_row[i1] == last_row[i2] && i1 < i2);
+    };
+    endpoints.clear();
+    for (size_t i = 1; i < last_row.size() && k > 0; ++i) {
+        if (last_row[i] <= 0) continue;
+        if (endpoints.size() < k) {
+            endpoints.push_back(i);
+            std::push_heap(endpoints.begin(), endpoints.end(), better);
+        } else if (better(i, endpoints.front())) {
+            std::pop_heap(endpoints.begin(), endpoints.end(), better);
+            endpoints.back() = i;
+            std::push_heap(endpoints.begin(), endpoints.end(), better);
         }
     }
+    std::sort_heap(endpoints.begin(), endpoints.end(), better);
+}
 
-    // The location of the highest scoring match in the
-    // last row or last column is the maximum scoring overlap
-    // for the pair of strings. We start the backtracking from
-    // that cell
+int Overlapper::minQualifiedScore(int n1, int n2, int minOverlap, double minIdentity, const OverlapperParams& params)
+{
+    // An overlap of L columns with e differences scores match * L less at
+    // most (match - worst) * e, worst being the mismatch or a gap it can
+    // afford, and e is at most (1 - minIdentity) * L. Less 1 for rounding
+    int worst = params.mismatch_penalty;
+    if ((long long)params.match_score * std::min(n1, n2) + params.gap_penalty > 0)
+        worst = std::min(worst, params.gap_penalty);
+    double perColumn = params.match_score - std::max(0, params.match_score - worst) * (1.0 - minIdentity);
+    if (minIdentity > 1.0 || perColumn <= 0 || minOverlap <= 0)
+        return 1;
+    return std::max(1, (int)(perColumn * minOverlap) - 1);
+}
+
+SequenceOverlap Overlapper::computeOverlapSW2(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    SequenceOverlap output;
+    if (!findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace))
+        error("No overlap was found.");
+    return output;
+}
 
-    std::vector<size_t> last_row_indexes(num_columns - 1);
-    for (size_t i = 1; i < num_columns; ++i) {
-        last_row_indexes[i-1] = i;
+bool Overlapper::findOverlapSW2(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace)
+{
+    // Exit with invalid intervals if either string is zero length
+    if(n1 == 0 || n2 == 0) {
+        std::cerr << "Overlapper::computeOverlapSW error: empty input sequence\n";
+        exit(EXIT_FAILURE);
     }
-    std::sort(last_row_indexes.begin(), last_row_indexes.end(),
-         [&score_matrix, num_rows](size_t i1, size_t i2) {return score_matrix[i1][num_rows - 1] > score_matrix[i2][num_rows - 1];});
 
-    int cnt = 0;
-    for (auto max_row_index: last_row_indexes) {
-        if (cnt >= 10) break;
-        auto max_row_value = score_matrix[max_row_index][num_rows - 1];
+    // Fill the matrix, keeping the traceback and the scores of the last row.
+    // Cells off every path to a qualified score are skipped; the endpoints
+    // below it are not backtracked, as the traceback may not reach them
+    const int min_score = minQualifiedScore(n1, n2, minOverlap, minIdentity, params);
+    OverlapperSIMD::fillSW2(s1, n1, s2, n2, params, workspace, min_score);
+    const TracebackMatrix& traceback = workspace.traceback;
+    const std::vector<int>& last_row = workspace.lastRow;
+    if (*std::max_element(last_row.begin(), last_row.end()) < min_score)
+        return false;
+
+    // The location of the highest scoring match in the
+    // last row is the maximum scoring overlap for the
+    // pair of strings. We try the best few cells in turn
+    std::vector<size_t>& last_row_indexes = workspace.endpoints;
+    selectEndpoints(last_row, 10, last_row_indexes);
 
+    for (auto max_row_index: last_row_indexes) {
+        if (last_row[max_row_index] < min_score)
+            break;
         // Compute the location at which to start the backtrack
         size_t i = max_row_index;
-        size_t j = num_rows - 1;
-        output.score = max_row_value;
+        size_t j = n2;
+        output.score = last_row[max_row_index];
 
         // Set the alignment endpoints to be the index of the last aligned base
         output.match[0].end = i - 1;
         output.match[1].end = j - 1;
-        output.length[0] = s1.length();
-        output.length[1] = s2.length();
+        output.length[0] = n1;
+        output.length[1] = n2;
     #ifdef DEBUG_OVERLAPPER
         printf("Endpoints selected: (%d %d) with score %d\n", output.match[0].end, output.match[1].end, output.score);
     #endif
@@ -686,34 +757,24 @@ SequenceOverlap Overlapper::computeOverlapSW2(const std::string& s1, const std::
         output.edit_distance = 0;
         output.total_columns = 0;
 
-        std::string cigar;
-        while(i > 0 && j > 0 && score_matrix[i][j] > 0) {
-            // Compute the possible previous locations of the path
-            int idx_1 = i - 1;
-            int idx_2 = j - 1;
-
-            bool is_match = s1[idx_1] == s2[idx_2];
-            int diagonal = score_matrix[i - 1][j - 1] + (is_match ? params.match_score : params.mismatch_penalty);
-            int up = score_matrix[i][j-1] + params.gap_penalty;
-            int left = score_matrix[i-1][j] + params.gap_penalty;
-//            int gap_pen = (j == num_rows - 1) ? 0 : params.gap_penalty;
-//            int left = score_matrix[i-1][j] + gap_pen;
-
-            // If there are multiple possible paths to this cell
-            // we break ties in order of insertion,deletion,match
+        std::string& cigar = workspace.cigar;
+        cigar.clear();
+        TracebackMatrix::Direction direction;
+        while(i > 0 && j > 0 && (direction = traceback(i, j)) != TracebackMatrix::STOP) {
+            // If there are multiple possible paths to a cell the fill
+            // breaks ties in order of insertion,deletion,match
             // this helps left-justify matches for homopolymer runs
             // of unequal lengths
-            if(score_matrix[i][j] == up) {
+            if(direction == TracebackMatrix::UP) {
                 cigar.push_back('I');
                 j -= 1;
                 output.edit_distance += 1;
-            } else if(score_matrix[i][j] == left) {
+            } else if(direction == TracebackMatrix::LEFT) {
                 cigar.push_back('D');
                 i -= 1;
                 output.edit_distance += 1;
             } else {
-                assert(score_matrix[i][j] == diagonal);
-                if(!is_match)
+                if(s1[i - 1] != s2[j - 1])
                     output.edit_distance += 1;
                 cigar.push_back('M');
                 i -= 1;
@@ -727,24 +788,15 @@ SequenceOverlap Overlapper::computeOverlapSW2(const std::string& s1, const std::
         output.match[0].start = i;
         output.match[1].start = j;
 
-//        std::string s0 = "CTGCCCCAAATACAGCTACTGCCACCACCAAGGCGGCTGTTGGTGCCCTGCAGTCAACAGCCAGTCTCTTCGTGGTCTCACTCTCTCTTCTACATCTCTCC";
-//        std::reverse(s0.begin(), s0.end());
-
         // Compact the expanded cigar string into the canonical run length encoding
         // The backtracking produces a cigar string in reversed order, flip it
-        if (cigar.empty()) continue;
         std::reverse(cigar.begin(), cigar.end());
         output.cigar = compactCigar(cigar);
 
-//        if (s2 == s0)
-//            output.printAlignment(s1, s2);
-
         if (output.isQualified(minOverlap, minIdentity))
-            return output;
-
-        cnt++;
+            return true;
     }
-    error("No overlap was found.");
+    return false;
 }
 
 // Returns the index into a cell vector for for the ith column and jth row
@@ -759,7 +811,7 @@ inline int _getBandedCellIndex(int i, int j, int band_width, int band_origin_row
 }
 
 // Returns the score for (i,j) in the 
-inline int _getBandedCellScore(const DPCells& cells, int i, int j, int band_width, int band_origin_row, int invalid_score)
+inline int _getBandedCellScore(const int* cells, int i, int j, int band_width, int band_origin_row, int invalid_score)
 {
     int band_start = band_origin_row + i;
     int band_row_index = j - band_start;
@@ -767,7 +819,7 @@ inline int _getBandedCellScore(const DPCells& cells, int i, int j, int band_widt
 }
 
 SequenceOverlap Overlapper::extendMatch(const std::string& s1, const std::string& s2, 
-                                        int start_1, int start_2, int band_width)
+                                        int start_1, int start_2, int band_width, AlignmentWorkspace& workspace)
 {
     SequenceOverlap output;
     int num_columns = s1.size() + 1;
@@ -786,7 +838,8 @@ SequenceOverlap Overlapper::extendMatch(const std::string& s1, const std::string
 
     // Allocate bands with uninitialized scores
     int INVALID_SCORE = std::numeric_limits<int>::min();
-    DPCells cells(num_cells_required, 0);
+    int* cells = workspace.buffer<int>(0, num_cells_required);
+    std::fill(cells, cells + num_cells_required, 0);
 
     // Calculate the band center coordinates in the first
     // column of the multiple alignment. These are calculated by
@@ -797,7 +850,7 @@ SequenceOverlap Overlapper::extendMatch(const std::string& s1, const std::string
 #ifdef DEBUG_EXTEND
     printf("Match start: [%d %d]\n", start_1, start_2);
     printf("Band center, origin: [%d %d]\n", band_center, band_origin);
-    printf("Num cells: %zu\n", cells.size());
+    printf("Num cells: %zu\n", num_cells_required);
 #endif
 
     // Fill in the bands column by column
@@ -945,7 +998,8 @@ SequenceOverlap Overlapper::extendMatch(const std::string& s1, const std::string
     output.edit_distance = 0;
     output.total_columns = 0;
 
-    std::string cigar;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
     while(i > 0 && j > 0) {
         // Compute the possible previous locations of the path
         int idx_1 = i - 1;
@@ -1004,10 +1058,8 @@ struct AffineCell
     int D;
 };
 
-typedef std::vector<AffineCell> AffineCells;
-typedef std::vector<AffineCells> AffineMatrix;
-
-SequenceOverlap Overlapper::computeOverlapAffine(const std::string& s1, const std::string& s2, const OverlapperParams params)
+template<class Params>
+static SequenceOverlap computeOverlapAffineKernel(const std::string& s1, const std::string& s2, const Params& params, AlignmentWorkspace& workspace)
 {
     // Exit with invalid intervals if either string is zero length
     SequenceOverlap output;
@@ -1023,10 +1075,7 @@ SequenceOverlap Overlapper::computeOverlapAffine(const std::string& s1, const st
     int gap_open = 5;
     int gap_ext = 2;
 
-    AffineMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
+    DPView<AffineCell> score_matrix = workspace.matrix<AffineCell>(0, num_columns, num_rows);
 
     // Calculate scores
     for(size_t i = 1; i < num_columns; ++i) {
@@ -1112,7 +1161,8 @@ SequenceOverlap Overlapper::computeOverlapAffine(const std::string& s1, const st
     output.edit_distance = 0;
     output.total_columns = 0;
 
-    std::string cigar;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
     while(i > 0 && j > 0) {
         // Compute the possible previous locations of the path
         int idx_1 = i - 1;
@@ -1160,10 +1210,27 @@ SequenceOverlap Overlapper::computeOverlapAffine(const std::string& s1, const st
     // The backtracking produces a cigar string in reversed order, flip it
     std::reverse(cigar.begin(), cigar.end());
     assert(!cigar.empty());
-    output.cigar = compactCigar(cigar);
+    output.cigar = Overlapper::compactCigar(cigar);
     return output;
 }
 
+struct ComputeOverlapAffineCall
+{
+    typedef SequenceOverlap result_type;
+    const std::string& s1;
+    const std::string& s2;
+    AlignmentWorkspace& workspace;
+
+    template<class Params>
+    SequenceOverlap operator()(const Params& params) const { return computeOverlapAffineKernel(s1, s2, params, workspace); }
+};
+
+SequenceOverlap Overlapper::computeOverlapAffine(const std::string& s1, const std::string& s2, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    ComputeOverlapAffineCall kernel = { s1, s2, workspace };
+    return dispatchParams(params, kernel);
+}
+
 // Compact an expanded CIGAR string into a regular cigar string
 std::string Overlapper::compactCigar(const std::string& ecigar)
 {
@@ -1189,226 +1256,14 @@ std::string Overlapper::compactCigar(const std::string& ecigar)
 }
 
 
-SequenceOverlap Overlapper::ageAlignPrefix(const std::string &s1, const std::string &s2, const ScoreParam &score_param)
-{
-    SequenceOverlap output;
-
-    const int NONE = 0;
-    const int DIAGONAL = 1;
-    const int VERTICAL = 2;
-    const int HORIZONTAL = 3;
-
-    int orientation_table[] = {NONE, DIAGONAL, VERTICAL, HORIZONTAL};
-    int orientation_table_m[] = {NONE, HORIZONTAL, VERTICAL};
-
-    output.length[0] = s1.size();
-    output.length[1] = s2.size();
-
-    size_t num_columns = s1.size() + 2;
-    size_t num_rows = s2.size() + 2;
-
-    DPMatrix S(num_rows, DPCells(num_columns));
-    DPMatrix S_backtrace(num_rows, DPCells(num_columns));
-    DPMatrix S_lower(num_rows, DPCells(num_columns));
-    DPMatrix S_upper(num_rows, DPCells(num_columns));
-
-    // calculate score matrix
-    for (size_t i = 1; i < num_rows-1; ++i) {
-        for (size_t j = 1; j < num_columns-1; ++j) {
-            S_lower[i][j] = std::max(S_lower[i-1][j] - score_param.gap, S[i-1][j] - score_param.gap_start);
-            S_upper[i][j] = std::max(S_upper[i][j-1] - score_param.gap, S[i][j-1] - score_param.gap_start);
-            int middle_scores[] = {0, S[i-1][j-1] + score_param.matchChar(s1[j-1], s2[i-1]), S_lower[i][j], S_upper[i][j]};
-            const int N = sizeof(middle_scores) / sizeof(int);
-            auto max_it = std::max_element(middle_scores, middle_scores + N);
-            S[i][j] = *max_it;
-            S_backtrace[i][j] = orientation_table[std::distance(middle_scores, max_it)];
-        }
-    }
-
-    DPMatrix R(num_rows, DPCells(num_columns));
-    DPMatrix R_backtrace(num_rows, DPCells(num_columns));
-    DPMatrix R_lower(num_rows, DPCells(num_columns));
-    DPMatrix R_upper(num_rows, DPCells(num_columns));
-
-    for (size_t i = num_rows-2; i > 0; --i) {
-        for (size_t j = num_columns-2; j > 0; --j) {
-            R_lower[i][j] = std::max(R_lower[i+1][j] - score_param.gap, R[i+1][j] - score_param.gap_start);
-            R_upper[i][j] = std::max(R_upper[i][j+1] - score_param.gap, R[i][j+1] - score_param.gap_start);
-            int middle_scores[] = {0, R[i+1][j+1] + score_param.matchChar(s1[j-1], s2[i-1]), R_lower[i][j], R_upper[i][j]};
-            const int N = sizeof(middle_scores) / sizeof(int);
-            auto max_it = std::max_element(middle_scores, middle_scores + N);
-            R[i][j] = *max_it;
-            R_backtrace[i][j] = orientation_table[std::distance(middle_scores, max_it)];
-        }
-    }
-
-
-    DPMatrix M_backtrace(num_rows, DPCells(num_columns));
-
-    for (size_t i = 1; i < num_rows-1; ++i) {
-        M_backtrace[i][0] = VERTICAL;
-    }
-
-    for (size_t j = 1; j < num_columns-1; ++j) {
-        M_backtrace[0][j] = HORIZONTAL;
-    }
-
-    // calculate maximum matrix
-    for (size_t i = 1; i < num_rows-1; ++i) {
-        for (size_t j = 1; j < num_columns-1; ++j) {
-            int scores[] = {S[i][j], S[i][j-1], S[i-1][j]};
-            const int N = sizeof(scores) / sizeof(int);
-            auto max_it = std::max_element(scores, scores + N);
-            S[i][j] = *max_it;
-            M_backtrace[i][j] = orientation_table_m[std::distance(scores, max_it)];
-        }
-    }
-
-    DPMatrix MR_backtrace(num_rows, DPCells(num_columns));
-
-    for (size_t i = num_rows-2; i > 0; --i) {
-        MR_backtrace[i][num_columns-1] = VERTICAL;
-    }
-
-    for (size_t j = num_columns-2; j > 0; --j) {
-        MR_backtrace[num_rows-1][j] = HORIZONTAL;
-    }
-
-    // calculate maximum matrix
-    for (size_t i = num_rows-2; i > 0; --i) {
-        for (size_t j = num_columns-2; j > 0; --j) {
-            int scores[] = {R[i][j], R[i][j+1], R[i+1][j]};
-            const int N = sizeof(scores) / sizeof(int);
-            auto max_it = std::max_element(scores, scores + N);
-            R[i][j] = *max_it;
-            MR_backtrace[i][j] = orientation_table_m[std::distance(scores, max_it)];
-        }
-    }
-
-//    for (size_t i = 0; i < num_rows; ++i) {
-//        for (size_t j = 0; j < num_columns; ++j) {
-//            std::cout << S[i][j] << ' ';
-//        }
-//        std::cout << std::endl;
-//    }
-//    std::cout << std::endl;
-
-//    for (size_t i = 0; i < num_rows; ++i) {
-//        for (size_t j = 0; j < num_columns; ++j) {
-//            std::cout << M_backtrace[i][j] << ' ';
-//        }
-//        std::cout << std::endl;
-//    }
-//    std::cout << std::endl;
-
-//    for (size_t i = 0; i < num_rows; ++i) {
-//        for (size_t j = 0; j < num_columns; ++j) {
-//            std::cout << R[i][j] << ' ';
-//        }
-//        std::cout << std::endl;
-//    }
-//    std::cout << std::endl;
-
-//    for (size_t i = 0; i < num_rows; ++i) {
-//        for (size_t j = 0; j < num_columns; ++j) {
-//            std::cout << MR_backtrace[i][j] << ' ';
-//        }
-//        std::cout << std::endl;
-//    }
-//    std::cout << std::endl;
-
-    int max_score = 0;
-    int max_row_index = 0;
-    int max_column_index = 0;
-
-    for (size_t i = 0; i < num_rows-1; ++i) {
-        for (size_t j = 0; j < num_columns-1; ++j) {
-            int val = S[i][j] + R[i+1][j+1];
-            if (max_score < val) max_score = val;
-        }
-    }
-
-    for (size_t i = 0; i < num_rows-1; ++i) {
-        for (size_t j = 0; j < num_columns-1; ++j) {
-            if (M_backtrace[i][j] == NONE && S[i][j] + R[i+1][j+1] == max_score) {
-                max_row_index = i;
-                max_column_index = j;
-                goto theEnd;
-            }
-        }
-    }
-
-theEnd:
-    output.score = max_score;
-    output.match[0].end = max_column_index - 1;
-    output.match[1].end = max_row_index - 1;
-
-#ifdef DEBUG_OVERLAPPER
-    printf("Endpoints selected: (%d %d) with score %d\n", output.match[0].end, output.match[1].end, output.score);
-#endif
-
-    output.edit_distance = 0;
-    output.total_columns = 0;
-
-    int i = max_row_index;
-    int j = max_column_index;
-    std::string cigar;
-
-    while (S_backtrace[i][j] != NONE && i*j !=0) {
-        if (S_backtrace[i][j] == VERTICAL) {
-            cigar.push_back('I');
-            output.edit_distance += 1;
-            i--;
-        } else if(S_backtrace[i][j] == HORIZONTAL) {
-            cigar.push_back('D');
-            output.edit_distance += 1;
-            j--;
-        } else {
-            if (s1[j-1] != s2[i-1]) {
-                output.edit_distance += 1;
-            }
-            cigar.push_back('M');
-            i--;
-            j--;
-        }
-        output.total_columns += 1;
-    }
-
-    output.match[0].start = j;
-    output.match[1].start = i;
-
-    std::reverse(cigar.begin(), cigar.end());
-    assert(!cigar.empty());
-    output.cigar = compactCigar(cigar);
-
-    return output;
-}
-
-
-SequenceOverlap Overlapper::ageAlignSuffix(const std::string &s1, const std::string &s2, const ScoreParam &score_param)
-{
-    std::string s1_r = s1;
-    std::reverse(s1_r.begin(), s1_r.end());
-    std::string s2_r = s2;
-    std::reverse(s2_r.begin(), s2_r.end());
-
-    SequenceOverlap output = ageAlignPrefix(s1_r, s2_r, score_param);
-
-    output.match[0].flipStrand(output.length[0]);
-    output.match[1].flipStrand(output.length[1]);
-
-    return output;
-}
-
-
-SequenceOverlap Overlapper::alignPrefix(const std::string &s1, const std::string &s2, const OverlapperParams params)
+SequenceOverlap Overlapper::alignPrefix(const std::string &s1, const std::string &s2, const OverlapperParams params, AlignmentWorkspace &workspace)
 {
     std::string s1_r = s1;
     std::reverse(s1_r.begin(), s1_r.end());
     std::string s2_r = s2;
     std::reverse(s2_r.begin(), s2_r.end());
 
-    SequenceOverlap output = alignSuffix(s1_r, s2_r, params);
+    SequenceOverlap output = alignSuffix(s1_r, s2_r, params, workspace);
 
     output.match[0].flipStrand(output.length[0]);
     output.match[1].flipStrand(output.length[1]);
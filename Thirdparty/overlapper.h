@@ -27,8 +27,11 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 #include <assert.h>
 
+#include "overlapper_workspace.h"
+
 // A start/end coordinate pair representing
 // a subsequence. The end coordinate is
 // the index of the last base aligned.
@@ -137,6 +140,43 @@ struct OverlapperParams
     int mismatch_penalty;
 };
 
+// A pair of sequences for computeOverlapBatch, s1 being the target
+struct OverlapPair
+{
+    const char *s1;
+    int n1;
+    const char *s2;
+    int n2;
+};
+
+// The score of every byte against each base of a target s1, built once and
+// shared by all reads computeOverlapMany aligns to the target. Reads of up
+// to maxReadLength bases can be aligned
+class OverlapProfile
+{
+public:
+    OverlapProfile(const char *s1, int n1, int maxReadLength, const OverlapperParams& params);
+
+    const char *sequence() const { return s1; }
+    int length() const { return n1; }
+    int getMaxReadLength() const { return padding; }
+    const OverlapperParams& getParams() const { return params; }
+
+    // The scores of c against s1 behind maxReadLength positions that match
+    // nothing, and in front of 16 more: row(c)[maxReadLength + i] is the
+    // score of c against s1[i]
+    const int16_t *row(char c) const { return &scores[rowOf[(unsigned char)c] * width]; }
+
+private:
+    const char *s1;
+    int n1;
+    int padding;
+    OverlapperParams params;
+    std::size_t width;
+    std::size_t rowOf[256];
+    std::vector<int16_t> scores;
+};
+
 struct ScoreParam
 {
 
@@ -157,8 +197,44 @@ struct ScoreParam
 
 };
 
+// Scoring parameters fixed at compile time. They stand in for an
+// OverlapperParams in the templated alignment kernels, so that the scores
+// are folded into the code
+template<int Match, int Gap, int Mismatch>
+struct StaticOverlapperParams
+{
+    static const int match_score = Match;
+    static const int gap_penalty = Gap;
+    static const int mismatch_penalty = Mismatch;
+
+    static bool matches(const OverlapperParams& params)
+    {
+        return params.match_score == Match && params.gap_penalty == Gap && params.mismatch_penalty == Mismatch;
+    }
+};
+
+template<int Match, int Gap, int Mismatch> const int StaticOverlapperParams<Match, Gap, Mismatch>::match_score;
+template<int Match, int Gap, int Mismatch> const int StaticOverlapperParams<Match, Gap, Mismatch>::gap_penalty;
+template<int Match, int Gap, int Mismatch> const int StaticOverlapperParams<Match, Gap, Mismatch>::mismatch_penalty;
+
+typedef StaticOverlapperParams<2, -6, -3> DefaultParams;
+typedef StaticOverlapperParams<2, -10000, -3> UngappedParams;
+typedef StaticOverlapperParams<1, -3, -1> Svseq2Params;
+
+// Run a kernel with the compile-time version of params if there is one, with
+// params itself otherwise. Kernel has a result_type and an operator()
+// templated on the parameter type.
+template<class Kernel>
+typename Kernel::result_type dispatchParams(const OverlapperParams& params, const Kernel& kernel)
+{
+    if (DefaultParams::matches(params)) return kernel(DefaultParams());
+    if (UngappedParams::matches(params)) return kernel(UngappedParams());
+    if (Svseq2Params::matches(params)) return kernel(Svseq2Params());
+    return kernel(params);
+}
+
 // Global variables
-extern OverlapperParams default_params; // { 2, -5, -3 };
+extern OverlapperParams default_params; // { 2, -6, -3 };
 extern OverlapperParams ungapped_params; // { 2, -10000, -3 };
 extern OverlapperParams svseq2_params; // { 1, -3, -1 };
 
@@ -166,27 +242,92 @@ extern OverlapperParams svseq2_params; // { 1, -3, -1 };
 namespace Overlapper
 {
 
+// Every function computing an overlap takes the workspace to keep its dynamic
+// programming buffers in, by default the one of the calling thread
+
 // Compute the highest-scoring overlap between s1 and s2.
 // This is a naive O(M*N) algorithm with a linear gap penalty.
-SequenceOverlap computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
-SequenceOverlap computeOverlapSG(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
-
-SequenceOverlap alignSuffix(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
-SequenceOverlap alignPrefix(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
-
-SequenceOverlap computeOverlapSW2(const std::string& s1, const std::string& s2, int minOverlap, double minIdentity, const OverlapperParams params = default_params);
-
-SequenceOverlap ageAlignPrefix(const std::string& s1, const std::string& s2, const ScoreParam& score_param);
-SequenceOverlap ageAlignSuffix(const std::string& s1, const std::string& s2, const ScoreParam& score_param);
+SequenceOverlap computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+SequenceOverlap computeOverlapSG(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+SequenceOverlap alignSuffix(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+SequenceOverlap alignPrefix(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+SequenceOverlap computeOverlapSW2(const std::string& s1, const std::string& s2, int minOverlap, double minIdentity, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// The same on raw sequences, so that views into a reference can be aligned without copying
+SequenceOverlap computeOverlapSW2(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// The same without the exception: false if there is no qualified overlap
+bool findOverlapSW2(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+// The endpoints i (1 <= i < last_row.size()) of the k best positive scores in
+// last_row, best first. Equal scores are ordered by i, so the leftmost of tied
+// endpoints is tried first
+void selectEndpoints(const std::vector<int>& last_row, size_t k, std::vector<size_t>& endpoints);
+// A score every qualified overlap of computeOverlapSW2 reaches, at least 1
+int minQualifiedScore(int n1, int n2, int minOverlap, double minIdentity, const OverlapperParams& params);
+
+// True if a gap can never pay off for sequences of these lengths, as with ungapped_params
+bool isUngapped(int n1, int n2, const OverlapperParams& params);
+// computeOverlapSW2 for ungapped parameters, scanning only the diagonals.
+// Returns the same overlap; falls back to computeOverlapSW2 for other parameters
+SequenceOverlap computeOverlapUngapped(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params = ungapped_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// Without the exception, as the batches use it
+bool findOverlapUngapped(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+// The number of pairs computeOverlapBatch scans side by side, one per lane
+// of a vector; 1 if there is no vector kernel
+int batchWidth();
+// computeOverlapUngapped of many pairs at once, for short reads that would
+// leave most lanes of a vector idle on their own. Pairs of similar length
+// are scanned batchWidth() at a time, one pair per lane; pairs the ungapped
+// kernel cannot take are aligned one by one. Returns the overlap of each
+// pair; found[p] is false where there is no qualified overlap
+std::vector<SequenceOverlap> computeOverlapBatch(const std::vector<OverlapPair>& pairs, int minOverlap, double minIdentity, std::vector<bool>& found, const OverlapperParams params = ungapped_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// computeOverlapUngapped of many reads against one target, scanned on the
+// scores of its profile. The s1 of each pair is the part of the profile
+// sequence to align that read to. Pairs the profile cannot take, such as
+// reads longer than its maxReadLength, are aligned one by one
+std::vector<SequenceOverlap> computeOverlapMany(const OverlapProfile& profile, const std::vector<OverlapPair>& reads, int minOverlap, double minIdentity, std::vector<bool>& found, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+// False if computeOverlapSW2 cannot find a qualified overlap, checked in
+// O(n1 * n2 / 64) by bit-parallel edit distance (see overlapper_myers.cpp).
+// True means only that there may be one
+bool mayOverlap(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// Every qualified overlap of computeOverlapSW2 with an s2 of length n2 has a
+// run of at least this many matches, so it contains an exact seed that long
+int minSeedLength(int n2, int minOverlap, double minIdentity);
+
+// The longest suffix of s2 that occurs exactly in s1, ending leftmost in s1
+// if there are several, in O(n1 + n2). Throws if it does not qualify. This
+// is not always the overlap of computeOverlapSW2, which may run on through
+// a mismatch
+SequenceOverlap computeOverlapExact(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// False instead of the throw
+bool findOverlapExact(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+// The overlap of computeOverlapSW2 by wavefront alignment, in time that grows
+// with the number of differences rather than with n1 * n2: the highest-scoring
+// overlap among those with no more differences than a qualified one can have.
+// Falls back to computeOverlapSW2 if that overlap does not qualify, or if the
+// parameters do not turn into positive penalties. Ties between overlaps of the
+// same score may be broken differently
+SequenceOverlap computeOverlapWFA(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+// The same, false if no overlap qualifies
+bool findOverlapWFA(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+
+// AGE alignment of s1 and s2 (see overlapper_age.cpp). Keeps 2 bits per cell
+// for the backtrack and O(n1 * sqrt(n2)) scores
+SequenceOverlap ageAlignPrefix(const std::string& s1, const std::string& s2, const ScoreParam& score_param, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
+SequenceOverlap ageAlignSuffix(const std::string& s1, const std::string& s2, const ScoreParam& score_param, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
 
 // Extend a match between s1 and s2 into a full overlap using banded dynamic programming.
 // start_1/start_2 give the starting positions of the current partial alignment. These coordinates
 // are used to estimate where the overlap begins. The estimated alignment is refined by calculating
 // the overlap with banded dynamic programming
-SequenceOverlap extendMatch(const std::string& s1, const std::string& s2, int start_1, int start_2, int bandwidth);
+SequenceOverlap extendMatch(const std::string& s1, const std::string& s2, int start_1, int start_2, int bandwidth, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
 
 // Perform an alignment using affine gap penalties
-SequenceOverlap computeOverlapAffine(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
+SequenceOverlap computeOverlapAffine(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params, AlignmentWorkspace& workspace = AlignmentWorkspace::local());
 
 // Compact an expanded CIGAR string into a regular cigar string
 std::string compactCigar(const std::string& ecigar);
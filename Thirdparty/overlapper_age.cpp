@@ -0,0 +1,497 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_age - ageAlignPrefix and ageAlignSuffix in linear space
+//
+// The AGE alignment joins a local alignment of a prefix of both sequences to
+// one of the remaining suffixes. The forward matrix S scores the prefixes and
+// the reverse matrix R the suffixes, with affine gaps; M(i, j) is the best S
+// in the rectangle up to (i, j), MR(i, j) the best R in the one from (i, j),
+// and the split is the cell where M(i, j) + MR(i + 1, j + 1) is highest.
+//
+// Only the moves of S are backtracked, so they are the one matrix kept, in 2
+// bits a cell; everything else is rolling rows. The reverse pass is the
+// forward recurrence on both sequences reversed. As it runs in the opposite
+// direction, it is swept once keeping its rows every sqrt(n2) rows, then
+// recomputed a block at a time from those checkpoints as the forward pass
+// reaches the block.
+//
+// A row only depends on the row before but for the horizontal gaps and the
+// running maxima, which are prefix scans along the row. When a gap costs no
+// less to open than to extend, a gap never pays off opened from a cell that
+// ends in one, so the horizontal gaps can be scanned from the scores without
+// them, and a row is filled a vector of cells at a time.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper.h"
+#include "overlapper_simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OVERLAPPER_X86 1
+#include <immintrin.h>
+#endif
+
+enum AgeMove { NONE = 0, DIAGONAL = 1, VERTICAL = 2, HORIZONTAL = 3 };
+
+// A row of one pass over columns 0..n1 + 1: the scores, the scores of the
+// alignments ending in a vertical gap and the running maxima
+struct AgeRows
+{
+    int *score;
+    int *lower;
+    int *maximum;
+};
+
+// The first cell in row-major order with the highest M + MR among the cells
+// whose running maximum is their own score
+struct AgeSplit
+{
+    int score;
+    int row;
+    int column;
+    bool found;
+
+    void add(int i, int j, int value, bool none)
+    {
+        if (value > score) {
+            score = value;
+            found = false;
+        }
+        if (none && !found && value == score) {
+            row = i;
+            column = j;
+            found = true;
+        }
+    }
+
+    // The lowest value add can still act on
+    int threshold() const { return found ? score + 1 : score; }
+};
+
+// One row of a pass, from the row before in prev. The forward pass also
+// records the moves, in two bit planes of (n1 + 7) / 8 bytes, and offers
+// the cells of row i to split with mr, the row i + 1 of MR.
+struct AgeRow
+{
+    const char *s1;
+    int n1;
+    char c2;
+    const ScoreParam *sp;
+    AgeRows prev;
+    AgeRows row;
+    uint8_t *moves;
+    int i;
+    const int *mr;
+    AgeSplit *split;
+};
+
+typedef void (*AgeSweep)(const AgeRow& r);
+
+// Cells from..n1, with upper the horizontal gap score of cell from and left
+// the running maximum of the cell before it
+static void sweepCells(const AgeRow& r, int from, int upper, int left)
+{
+    const ScoreParam& sp = *r.sp;
+    const int bytes = (r.n1 + 7) / 8;
+    for (int j = from; j <= r.n1; ++j) {
+        int lower = std::max(r.prev.lower[j] - sp.gap, r.prev.score[j] - sp.gap_start);
+        int d = r.prev.score[j - 1] + sp.matchChar(r.s1[j - 1], r.c2);
+        int score = std::max(0, std::max(d, lower));
+        int m = score == 0 ? NONE : d == score ? DIAGONAL : VERTICAL;
+        if (upper > score) {
+            score = upper;
+            m = HORIZONTAL;
+        }
+        r.row.lower[j] = lower;
+        r.row.score[j] = score;
+
+        int above = r.prev.maximum[j];
+        int maximum = std::max(score, std::max(left, above));
+        r.row.maximum[j] = maximum;
+
+        if (r.moves != NULL) {
+            int byte = (j - 1) / 8, bit = (j - 1) % 8;
+            if (bit == 0) r.moves[byte] = r.moves[bytes + byte] = 0;
+            r.moves[byte] |= (m & 1) << bit;
+            r.moves[bytes + byte] |= (m >> 1) << bit;
+        }
+        if (r.split != NULL)
+            r.split->add(r.i, j, maximum + r.mr[j + 1], score >= left && score >= above);
+
+        upper = std::max(upper - sp.gap, score - sp.gap_start);
+        left = maximum;
+    }
+}
+
+static void sweepScalar(const AgeRow& r)
+{
+    sweepCells(r, 1, -std::min(r.sp->gap, r.sp->gap_start), 0);
+}
+
+#ifdef OVERLAPPER_X86
+
+// Shift the lanes of x up by 1, 2 or 4, shifting in zeros
+__attribute__((target("avx2")))
+static inline __m256i shiftLanes1(__m256i x) { return _mm256_alignr_epi8(x, _mm256_permute2x128_si256(x, x, 0x08), 12); }
+__attribute__((target("avx2")))
+static inline __m256i shiftLanes2(__m256i x) { return _mm256_alignr_epi8(x, _mm256_permute2x128_si256(x, x, 0x08), 8); }
+__attribute__((target("avx2")))
+static inline __m256i shiftLanes4(__m256i x) { return _mm256_permute2x128_si256(x, x, 0x08); }
+
+// The vector sweeps scan the horizontal gap scores offset by gap_start + 1,
+// so that they are positive and the zeros shifted in never win
+__attribute__((target("sse4.1")))
+static void sweepSSE41(const AgeRow& r)
+{
+    const ScoreParam& sp = *r.sp;
+    const __m128i vGap = _mm_set1_epi32(sp.gap);
+    const __m128i vGap2 = _mm_set1_epi32(2 * sp.gap);
+    const __m128i vDecay = _mm_setr_epi32(sp.gap, 2 * sp.gap, 3 * sp.gap, 4 * sp.gap);
+    const __m128i vGapStart = _mm_set1_epi32(sp.gap_start);
+    const __m128i vOffset = _mm_set1_epi32(sp.gap_start + 1);
+    const __m128i vMatch = _mm_set1_epi32(sp.match);
+    const __m128i vMismatch = _mm_set1_epi32(sp.mismatch);
+    const __m128i vC2 = _mm_set1_epi8(r.c2);
+    const __m128i vZero = _mm_setzero_si128();
+    const __m128i vOne = _mm_set1_epi32(1);
+    const __m128i vTwo = _mm_set1_epi32(2);
+    const __m128i vThree = _mm_set1_epi32(3);
+    const int bytes = (r.n1 + 7) / 8;
+
+    __m128i carryUpper = _mm_set1_epi32(sp.gap_start - sp.gap + 1);
+    __m128i carryLeft = vZero;
+    int j = 1;
+    for (; j + 3 <= r.n1; j += 4) {
+        __m128i up = _mm_loadu_si128((const __m128i *)(r.prev.score + j));
+        __m128i lower = _mm_max_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i *)(r.prev.lower + j)), vGap),
+                                      _mm_sub_epi32(up, vGapStart));
+        int32_t chars;
+        memcpy(&chars, r.s1 + j - 1, sizeof(chars));
+        __m128i eq = _mm_cvtepi8_epi32(_mm_cmpeq_epi8(_mm_cvtsi32_si128(chars), vC2));
+        __m128i d = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(r.prev.score + j - 1)),
+                                  _mm_blendv_epi8(vMismatch, vMatch, eq));
+        __m128i best = _mm_max_epi32(vZero, _mm_max_epi32(d, lower));
+        __m128i m = _mm_sub_epi32(vTwo, _mm_and_si128(_mm_cmpeq_epi32(d, best), vOne));
+        m = _mm_andnot_si128(_mm_cmpeq_epi32(best, vZero), m);
+
+        __m128i x = _mm_add_epi32(best, vOne);
+        x = _mm_max_epi32(x, _mm_sub_epi32(_mm_slli_si128(x, 4), vGap));
+        x = _mm_max_epi32(x, _mm_sub_epi32(_mm_slli_si128(x, 8), vGap2));
+        x = _mm_max_epi32(x, _mm_sub_epi32(carryUpper, vDecay));
+        __m128i upper = _mm_sub_epi32(_mm_blend_epi16(_mm_slli_si128(x, 4), carryUpper, 0x03), vOffset);
+        carryUpper = _mm_shuffle_epi32(x, 0xff);
+
+        __m128i horizontal = _mm_cmpgt_epi32(upper, best);
+        __m128i score = _mm_max_epi32(best, upper);
+        m = _mm_blendv_epi8(m, vThree, horizontal);
+
+        __m128i above = _mm_loadu_si128((const __m128i *)(r.prev.maximum + j));
+        __m128i t = _mm_max_epi32(score, above);
+        t = _mm_max_epi32(t, _mm_slli_si128(t, 4));
+        t = _mm_max_epi32(t, _mm_slli_si128(t, 8));
+        t = _mm_max_epi32(t, carryLeft);
+        __m128i left = _mm_blend_epi16(_mm_slli_si128(t, 4), carryLeft, 0x03);
+        carryLeft = _mm_shuffle_epi32(t, 0xff);
+
+        _mm_storeu_si128((__m128i *)(r.row.lower + j), lower);
+        _mm_storeu_si128((__m128i *)(r.row.score + j), score);
+        _mm_storeu_si128((__m128i *)(r.row.maximum + j), t);
+
+        if (r.moves != NULL) {
+            int byte = (j - 1) / 8, shift = (j - 1) % 8;
+            int bits0 = _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(m, 31)));
+            int bits1 = _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(m, 30)));
+            if (shift == 0) r.moves[byte] = r.moves[bytes + byte] = 0;
+            r.moves[byte] |= bits0 << shift;
+            r.moves[bytes + byte] |= bits1 << shift;
+        }
+        if (r.split != NULL) {
+            __m128i value = _mm_add_epi32(t, _mm_loadu_si128((const __m128i *)(r.mr + j + 1)));
+            if (_mm_movemask_epi8(_mm_cmplt_epi32(value, _mm_set1_epi32(r.split->threshold()))) != 0xffff) {
+                __m128i none = _mm_or_si128(_mm_cmpgt_epi32(left, score), _mm_cmpgt_epi32(above, score));
+                int values[4], nones[4];
+                _mm_storeu_si128((__m128i *)values, value);
+                _mm_storeu_si128((__m128i *)nones, none);
+                for (int k = 0; k < 4; ++k)
+                    r.split->add(r.i, j + k, values[k], nones[k] == 0);
+            }
+        }
+    }
+    sweepCells(r, j, _mm_cvtsi128_si32(carryUpper) - sp.gap_start - 1, _mm_cvtsi128_si32(carryLeft));
+}
+
+__attribute__((target("avx2")))
+static void sweepAVX2(const AgeRow& r)
+{
+    const ScoreParam& sp = *r.sp;
+    const __m256i vGap = _mm256_set1_epi32(sp.gap);
+    const __m256i vGap2 = _mm256_set1_epi32(2 * sp.gap);
+    const __m256i vGap4 = _mm256_set1_epi32(4 * sp.gap);
+    const __m256i vDecay = _mm256_mullo_epi32(vGap, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8));
+    const __m256i vGapStart = _mm256_set1_epi32(sp.gap_start);
+    const __m256i vOffset = _mm256_set1_epi32(sp.gap_start + 1);
+    const __m256i vMatch = _mm256_set1_epi32(sp.match);
+    const __m256i vMismatch = _mm256_set1_epi32(sp.mismatch);
+    const __m128i vC2 = _mm_set1_epi8(r.c2);
+    const __m256i vZero = _mm256_setzero_si256();
+    const __m256i vOne = _mm256_set1_epi32(1);
+    const __m256i vTwo = _mm256_set1_epi32(2);
+    const __m256i vThree = _mm256_set1_epi32(3);
+    const __m256i vLast = _mm256_set1_epi32(7);
+    const int bytes = (r.n1 + 7) / 8;
+
+    __m256i carryUpper = _mm256_set1_epi32(sp.gap_start - sp.gap + 1);
+    __m256i carryLeft = vZero;
+    int j = 1;
+    for (; j + 7 <= r.n1; j += 8) {
+        __m256i up = _mm256_loadu_si256((const __m256i *)(r.prev.score + j));
+        __m256i lower = _mm256_max_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(r.prev.lower + j)), vGap),
+                                         _mm256_sub_epi32(up, vGapStart));
+        __m128i a = _mm_loadl_epi64((const __m128i *)(r.s1 + j - 1));
+        __m256i eq = _mm256_cvtepi8_epi32(_mm_cmpeq_epi8(a, vC2));
+        __m256i d = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(r.prev.score + j - 1)),
+                                     _mm256_blendv_epi8(vMismatch, vMatch, eq));
+        __m256i best = _mm256_max_epi32(vZero, _mm256_max_epi32(d, lower));
+        __m256i m = _mm256_sub_epi32(vTwo, _mm256_and_si256(_mm256_cmpeq_epi32(d, best), vOne));
+        m = _mm256_andnot_si256(_mm256_cmpeq_epi32(best, vZero), m);
+
+        __m256i x = _mm256_add_epi32(best, vOne);
+        x = _mm256_max_epi32(x, _mm256_sub_epi32(shiftLanes1(x), vGap));
+        x = _mm256_max_epi32(x, _mm256_sub_epi32(shiftLanes2(x), vGap2));
+        x = _mm256_max_epi32(x, _mm256_sub_epi32(shiftLanes4(x), vGap4));
+        x = _mm256_max_epi32(x, _mm256_sub_epi32(carryUpper, vDecay));
+        __m256i upper = _mm256_sub_epi32(_mm256_blend_epi32(shiftLanes1(x), carryUpper, 0x01), vOffset);
+        carryUpper = _mm256_permutevar8x32_epi32(x, vLast);
+
+        __m256i horizontal = _mm256_cmpgt_epi32(upper, best);
+        __m256i score = _mm256_max_epi32(best, upper);
+        m = _mm256_blendv_epi8(m, vThree, horizontal);
+
+        __m256i above = _mm256_loadu_si256((const __m256i *)(r.prev.maximum + j));
+        __m256i t = _mm256_max_epi32(score, above);
+        t = _mm256_max_epi32(t, shiftLanes1(t));
+        t = _mm256_max_epi32(t, shiftLanes2(t));
+        t = _mm256_max_epi32(t, shiftLanes4(t));
+        t = _mm256_max_epi32(t, carryLeft);
+        __m256i left = _mm256_blend_epi32(shiftLanes1(t), carryLeft, 0x01);
+        carryLeft = _mm256_permutevar8x32_epi32(t, vLast);
+
+        _mm256_storeu_si256((__m256i *)(r.row.lower + j), lower);
+        _mm256_storeu_si256((__m256i *)(r.row.score + j), score);
+        _mm256_storeu_si256((__m256i *)(r.row.maximum + j), t);
+
+        if (r.moves != NULL) {
+            int byte = (j - 1) / 8;
+            r.moves[byte] = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(m, 31)));
+            r.moves[bytes + byte] = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(m, 30)));
+        }
+        if (r.split != NULL) {
+            __m256i value = _mm256_add_epi32(t, _mm256_loadu_si256((const __m256i *)(r.mr + j + 1)));
+            __m256i below = _mm256_cmpgt_epi32(_mm256_set1_epi32(r.split->threshold()), value);
+            if (_mm256_movemask_epi8(below) != -1) {
+                __m256i none = _mm256_or_si256(_mm256_cmpgt_epi32(left, score), _mm256_cmpgt_epi32(above, score));
+                int values[8], nones[8];
+                _mm256_storeu_si256((__m256i *)values, value);
+                _mm256_storeu_si256((__m256i *)nones, none);
+                for (int k = 0; k < 8; ++k)
+                    r.split->add(r.i, j + k, values[k], nones[k] == 0);
+            }
+        }
+    }
+    sweepCells(r, j, _mm256_cvtsi256_si32(carryUpper) - sp.gap_start - 1, _mm256_cvtsi256_si32(carryLeft));
+}
+
+#endif
+
+static AgeSweep selectSweep(const ScoreParam& sp)
+{
+#ifdef OVERLAPPER_X86
+    // The vector sweeps rely on gaps costing no less to open than to extend
+    if (sp.gap >= 0 && sp.gap <= sp.gap_start) {
+        if (OverlapperSIMD::level() == OverlapperSIMD::AVX2) return sweepAVX2;
+        if (OverlapperSIMD::level() == OverlapperSIMD::SSE41) return sweepSSE41;
+    }
+#endif
+    return sweepScalar;
+}
+
+// A row of a pass, the boundary columns included
+static void sweepRow(AgeSweep sweep, const AgeRow& r)
+{
+    r.row.score[0] = r.row.lower[0] = r.row.maximum[0] = 0;
+    r.row.score[r.n1 + 1] = r.row.lower[r.n1 + 1] = r.row.maximum[r.n1 + 1] = 0;
+    if (r.split != NULL)
+        r.split->add(r.i, 0, r.mr[1], false);
+    sweep(r);
+}
+
+SequenceOverlap Overlapper::ageAlignPrefix(const std::string &s1, const std::string &s2, const ScoreParam &score_param, AlignmentWorkspace &workspace)
+{
+    SequenceOverlap output;
+
+    output.length[0] = s1.size();
+    output.length[1] = s2.size();
+
+    const int n1 = s1.size();
+    const int n2 = s2.size();
+    const size_t width = n1 + 2;
+    const size_t plane_bytes = (n1 + 7) / 8;
+    AgeSweep sweep = selectSweep(score_param);
+
+    // Checkpoint c holds the reverse pass at row (c + 1) * block_rows + 1
+    const int block_rows = (int)std::ceil(std::sqrt(n2 + 1.0));
+    const int num_checkpoints = std::max(0, (n2 - 1) / block_rows);
+
+    int *forward = workspace.buffer<int>(0, 6 * width);
+    int *reverse = workspace.buffer<int>(1, 7 * width);
+    int *checkpoints = workspace.buffer<int>(2, 3 * width * num_checkpoints);
+    // The rows of MR of a block, in the order of s1
+    int *block = workspace.buffer<int>(3, block_rows * width);
+    uint8_t *moves = workspace.buffer<uint8_t>(4, 2 * plane_bytes * n2);
+    char *s1_r = workspace.buffer<char>(5, n1);
+    std::reverse_copy(s1.begin(), s1.end(), s1_r);
+
+    int *zeros = reverse + 6 * width;
+    std::fill(zeros, zeros + width, 0);
+    const AgeRows boundary = { zeros, zeros, zeros };
+
+    // The rows of the reverse pass are in the order of s1_r
+    AgeRow r = { s1_r, n1, 0, &score_param, boundary,
+                 { reverse, reverse + width, reverse + 2 * width }, NULL, 0, NULL, NULL };
+    AgeRows spare = { reverse + 3 * width, reverse + 4 * width, reverse + 5 * width };
+
+    // Sweep the reverse pass down to the first checkpoint
+    for (int i = n2; i > block_rows; --i) {
+        r.c2 = s2[i - 1];
+        sweepRow(sweep, r);
+        if ((i - 1) % block_rows == 0) {
+            int *checkpoint = checkpoints + 3 * width * ((i - 1) / block_rows - 1);
+            std::copy(r.row.score, r.row.score + width, checkpoint);
+            std::copy(r.row.lower, r.row.lower + width, checkpoint + width);
+            std::copy(r.row.maximum, r.row.maximum + width, checkpoint + 2 * width);
+        }
+        r.prev = r.row;
+        std::swap(r.row, spare);
+    }
+
+    AgeRow f = { s1.data(), n1, 0, &score_param,
+                 { forward, forward + width, forward + 2 * width },
+                 { forward + 3 * width, forward + 4 * width, forward + 5 * width }, NULL, 0, NULL, NULL };
+    std::fill(forward, forward + 3 * width, 0);
+    AgeSplit split = { 0, 0, 0, false };
+
+    for (int first = 0; first <= n2; first += block_rows) {
+        // Rows first + 1..top of MR, for rows first..top - 1 of M
+        int top = std::min(first + block_rows, n2 + 1);
+        int start = std::min(top, n2);
+        if (start < n2) {
+            int *checkpoint = checkpoints + 3 * width * (start / block_rows - 1);
+            r.prev.score = checkpoint;
+            r.prev.lower = checkpoint + width;
+            r.prev.maximum = checkpoint + 2 * width;
+        } else {
+            r.prev = boundary;
+        }
+        if (top == n2 + 1)
+            std::fill(block + (top - first - 1) * width, block + (top - first) * width, 0);
+        for (int i = start; i > first; --i) {
+            r.c2 = s2[i - 1];
+            sweepRow(sweep, r);
+            std::reverse_copy(r.row.maximum, r.row.maximum + width, block + (i - first - 1) * width);
+            r.prev = r.row;
+            std::swap(r.row, spare);
+        }
+
+        for (int i = first; i < top; ++i) {
+            const int *mr = block + (i - first) * width;
+            if (i == 0) {
+                for (int j = 0; j <= n1; ++j)
+                    split.add(0, j, mr[j + 1], j == 0);
+                continue;
+            }
+            f.c2 = s2[i - 1];
+            f.moves = moves + 2 * plane_bytes * (i - 1);
+            f.i = i;
+            f.mr = mr;
+            f.split = &split;
+            sweepRow(sweep, f);
+            std::swap(f.prev, f.row);
+        }
+    }
+
+    int max_score = split.score;
+    int max_row_index = split.found ? split.row : 0;
+    int max_column_index = split.found ? split.column : 0;
+
+    output.score = max_score;
+    output.match[0].end = max_column_index - 1;
+    output.match[1].end = max_row_index - 1;
+
+#ifdef DEBUG_OVERLAPPER
+    printf("Endpoints selected: (%d %d) with score %d\n", output.match[0].end, output.match[1].end, output.score);
+#endif
+
+    output.edit_distance = 0;
+    output.total_columns = 0;
+
+    int i = max_row_index;
+    int j = max_column_index;
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
+
+    while (i*j != 0) {
+        const uint8_t *row_moves = moves + 2 * plane_bytes * (i - 1) + (j - 1) / 8;
+        int bit = (j - 1) % 8;
+        int m = ((row_moves[0] >> bit) & 1) | (((row_moves[plane_bytes] >> bit) & 1) << 1);
+        if (m == NONE)
+            break;
+        if (m == VERTICAL) {
+            cigar.push_back('I');
+            output.edit_distance += 1;
+            i--;
+        } else if(m == HORIZONTAL) {
+            cigar.push_back('D');
+            output.edit_distance += 1;
+            j--;
+        } else {
+            if (s1[j-1] != s2[i-1]) {
+                output.edit_distance += 1;
+            }
+            cigar.push_back('M');
+            i--;
+            j--;
+        }
+        output.total_columns += 1;
+    }
+
+    output.match[0].start = j;
+    output.match[1].start = i;
+
+    std::reverse(cigar.begin(), cigar.end());
+    assert(!cigar.empty());
+    output.cigar = compactCigar(cigar);
+
+    return output;
+}
+
+
+SequenceOverlap Overlapper::ageAlignSuffix(const std::string &s1, const std::string &s2, const ScoreParam &score_param, AlignmentWorkspace &workspace)
+{
+    std::string s1_r = s1;
+    std::reverse(s1_r.begin(), s1_r.end());
+    std::string s2_r = s2;
+    std::reverse(s2_r.begin(), s2_r.end());
+
+    SequenceOverlap output = ageAlignPrefix(s1_r, s2_r, score_param, workspace);
+
+    output.match[0].flipStrand(output.length[0]);
+    output.match[1].flipStrand(output.length[1]);
+
+    return output;
+}
@@ -0,0 +1,68 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_exact - Exact overlaps in linear time
+//
+// The longest exact overlap is the longest suffix of s2 that ends somewhere
+// in s1. With both sequences reversed, that is the longest prefix of the
+// reversed s2 that starts at a position of the reversed s1, which the
+// Z-algorithm gives for every position of reversed s2 + separator + reversed
+// s1 in one pass.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper.h"
+#include "../error.h"
+
+#include <algorithm>
+#include <string>
+
+SequenceOverlap Overlapper::computeOverlapExact(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    SequenceOverlap output;
+    if (!findOverlapExact(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace))
+        error("No overlap was found.");
+    return output;
+}
+
+bool Overlapper::findOverlapExact(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace)
+{
+    const int n = n2 + 1 + n1;
+    char *text = workspace.buffer<char>(0, n);
+    std::reverse_copy(s2, s2 + n2, text);
+    text[n2] = '\0';
+    std::reverse_copy(s1, s1 + n1, text + n2 + 1);
+
+    // z[p] is the length of the longest common prefix of text and text + p
+    int *z = workspace.buffer<int>(1, n);
+    z[0] = n;
+    int best_length = 0, best_end = -1;
+    for (int p = 1, left = 0, right = 0; p < n; ++p) {
+        int length = p < right ? std::min(right - p, z[p - left]) : 0;
+        while (p + length < n && text[length] == text[p + length])
+            length++;
+        z[p] = length;
+        if (p + length > right) {
+            left = p;
+            right = p + length;
+        }
+        // Of equally long overlaps, the one ending leftmost in s1 comes last
+        if (p > n2 && length > 0 && length >= best_length) {
+            best_length = length;
+            best_end = n1 - 1 - (p - n2 - 1);
+        }
+    }
+
+    output = SequenceOverlap();
+    output.length[0] = n1;
+    output.length[1] = n2;
+    output.score = best_length * params.match_score;
+    output.edit_distance = 0;
+    output.total_columns = best_length;
+    if (best_length > 0) {
+        output.match[0].start = best_end - best_length + 1;
+        output.match[0].end = best_end;
+        output.match[1].start = n2 - best_length;
+        output.match[1].end = n2 - 1;
+        output.cigar = compactCigar(std::string(best_length, 'M'));
+    }
+    return best_length > 0 && output.isQualified(minOverlap, minIdentity);
+}
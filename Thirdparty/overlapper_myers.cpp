@@ -0,0 +1,131 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_myers - Bit-parallel test for a qualified computeOverlapSW2 overlap
+//
+// An overlap of computeOverlapSW2 aligns a suffix of s2 of length L to a
+// substring of s1 with d differences in at most L + d columns. It qualifies
+// only if d <= (1 - minIdentity) / minIdentity * L and L + d >= minOverlap,
+// so there is a least L, minLength(d), for each d. The minLength(d) last
+// bases of s2 are then within d edits of a substring of s1 as well.
+//
+// With both sequences reversed, the last bases of s2 become a prefix of the
+// pattern, and Myers' bit-parallel algorithm (in the blocked form of Hyyrö)
+// gives the edit distance of every prefix of the pattern to the best
+// substring of s1 ending at each column: the sum of the vertical deltas of
+// the column up to the row of the prefix. If no prefix of length
+// minLength(d) ever gets within d edits, there is no qualified overlap.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+static const int WORD_BITS = 64;
+
+// The least length of s2 a qualified overlap with this many differences can
+// cover, or n2 + 1 if it cannot fit in s2
+static int minLength(int differences, int n2, int minOverlap, double minIdentity)
+{
+    int length = std::max(minOverlap - differences, 1);
+    if (differences > 0) {
+        if (minIdentity >= 1.0) return n2 + 1;
+        double needed = differences * minIdentity / (1.0 - minIdentity) - 1e-6;
+        length = std::max(length, (int)needed + (needed > (int)needed ? 1 : 0));
+    }
+    return std::min(length, n2 + 1);
+}
+
+int Overlapper::minSeedLength(int n2, int minOverlap, double minIdentity)
+{
+    if (minIdentity <= 0)
+        return 0;
+    // The differences split the covered bases of s2, less the mismatched and
+    // inserted ones, into at most differences + 1 runs of matches
+    const int max_differences = (int)((1.0 - minIdentity) * n2 / minIdentity + 1e-6);
+    int seed_length = n2 + 1;
+    for (int d = 0; d <= max_differences; ++d) {
+        int length = minLength(d, n2, minOverlap, minIdentity);
+        if (length <= n2)
+            seed_length = std::min(seed_length, (length - d) / (d + 1));
+    }
+    return seed_length;
+}
+
+// The row of a prefix length whose distance is tracked, and the number of
+// differences it may have
+struct PrefixCheck
+{
+    int row;
+    int differences;
+    int distance;
+};
+
+bool Overlapper::mayOverlap(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, AlignmentWorkspace& workspace)
+{
+    if (n1 <= 0 || n2 <= 0 || minIdentity <= 0)
+        return true;
+
+    // The prefix length to check for each number of differences, by length
+    const int max_differences = (int)((1.0 - minIdentity) * n2 / minIdentity + 1e-6);
+    PrefixCheck *checks = workspace.buffer<PrefixCheck>(3, max_differences + 1);
+    int num_checks = 0;
+    for (int d = 0; d <= max_differences; ++d) {
+        int length = minLength(d, n2, minOverlap, minIdentity);
+        if (length <= n2)
+            checks[num_checks++] = PrefixCheck{ length - 1, d, length };
+    }
+    if (num_checks == 0)
+        return false;
+    std::sort(checks, checks + num_checks, [](const PrefixCheck& a, const PrefixCheck& b) { return a.row < b.row; });
+    const int pattern_length = checks[num_checks - 1].row + 1;
+    const int words = (pattern_length + WORD_BITS - 1) / WORD_BITS;
+
+    // The match masks of the reversed pattern, one set of words per distinct
+    // base. Bases of s1 not in the pattern match nothing
+    unsigned char slot[256] = { 0 };
+    int num_slots = 1;
+    for (int r = 0; r < pattern_length; ++r) {
+        unsigned char c = s2[n2 - 1 - r];
+        if (slot[c] == 0) slot[c] = num_slots++;
+    }
+    uint64_t *peq = workspace.buffer<uint64_t>(0, (size_t)num_slots * words);
+    std::fill(peq, peq + (size_t)num_slots * words, 0);
+    for (int r = 0; r < pattern_length; ++r)
+        peq[(size_t)slot[(unsigned char)s2[n2 - 1 - r]] * words + r / WORD_BITS] |= (uint64_t)1 << (r % WORD_BITS);
+
+    uint64_t *pv = workspace.buffer<uint64_t>(1, words);
+    uint64_t *mv = workspace.buffer<uint64_t>(2, words);
+    std::fill(pv, pv + words, ~(uint64_t)0);
+    std::fill(mv, mv + words, 0);
+
+    // One column of s1 at a time, each block of 64 rows taking the horizontal
+    // delta of the block above. The distance of a checked prefix follows the
+    // horizontal delta of its last row
+    for (int i = n1 - 1; i >= 0; --i) {
+        const uint64_t *eq_column = peq + (size_t)slot[(unsigned char)s1[i]] * words;
+        int hin = 0;
+        PrefixCheck *check = checks;
+        for (int w = 0; w < words; ++w) {
+            uint64_t eq = eq_column[w];
+            uint64_t xv = eq | mv[w];
+            if (hin < 0) eq |= 1;
+            uint64_t xh = (((eq & pv[w]) + pv[w]) ^ pv[w]) | eq;
+            uint64_t ph = mv[w] | ~(xh | pv[w]);
+            uint64_t mh = pv[w] & xh;
+            for (; check != checks + num_checks && check->row < (w + 1) * WORD_BITS; ++check) {
+                int bit = check->row - w * WORD_BITS;
+                check->distance += (int)((ph >> bit) & 1) - (int)((mh >> bit) & 1);
+                if (check->distance <= check->differences)
+                    return true;
+            }
+            int hout = (int)(ph >> (WORD_BITS - 1)) - (int)(mh >> (WORD_BITS - 1));
+            ph = ph << 1 | (hin > 0);
+            mh = mh << 1 | (hin < 0);
+            pv[w] = mh | ~(xv | ph);
+            mv[w] = ph & xv;
+            hin = hout;
+        }
+    }
+    return false;
+}
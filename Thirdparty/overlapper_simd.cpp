@@ -0,0 +1,404 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_simd - Vectorized fill of the computeOverlapSW2 matrix
+//
+// The matrix is filled one anti-diagonal at a time. Every cell of diagonal k
+// only depends on diagonals k - 1 and k - 2, so a vector of cells is computed
+// from three unaligned loads and a byte compare of s1 against s2 reversed, and
+// only these three diagonals of scores are kept. The move the backtrack takes
+// from each cell is derived from the same compares and stored in 2 bits.
+// Scores are kept in saturating 16-bit lanes; the vector kernels are only used
+// when the largest possible score fits, so saturation can only hit negative
+// values, which the local alignment clamps to 0 anyway.
+//
+// Given the least score of a qualified overlap, each diagonal is only filled
+// over the cells a path to that score can cross, by a bound on the score of
+// such a path that is solved for per diagonal in closed form.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper_simd.h"
+
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OVERLAPPER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace OverlapperSIMD
+{
+
+static std::atomic<int> maxLevel(AVX2);
+
+static Level detect()
+{
+#ifdef OVERLAPPER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SSE41;
+#endif
+    return SCALAR;
+}
+
+Level level()
+{
+    static const Level supported = detect();
+    return std::min(supported, (Level)maxLevel.load());
+}
+
+const char *levelName(Level level)
+{
+    switch (level) {
+    case AVX2: return "avx2";
+    case SSE41: return "sse4.1";
+    default: return "scalar";
+    }
+}
+
+void setMaxLevel(Level level)
+{
+    maxLevel = level;
+}
+
+// Three diagonals of scores indexed by i, rotated as the fill advances
+template<class Score>
+struct Diagonals
+{
+    Diagonals(int n1, int n2, AlignmentWorkspace& workspace) : n1(n1), n2(n2)
+    {
+        // The vector loads never reach past i = n1
+        previous = workspace.buffer<Score>(1, n1 + 1);
+        current = workspace.buffer<Score>(2, n1 + 1);
+        beforePrevious = workspace.buffer<Score>(3, n1 + 1);
+        // Diagonals 0 and 1 only hold boundary cells
+        previous[0] = 0;
+        current[0] = 0;
+        if (n1 >= 1) current[1] = 0;
+    }
+
+    // Move on to diagonal k, whose boundary cells are 0
+    void advance(int k)
+    {
+        std::swap(beforePrevious, previous);
+        std::swap(previous, current);
+        if (k <= n2) current[0] = 0;
+        if (k <= n1) current[k] = 0;
+    }
+
+    int n1;
+    int n2;
+    Score *current, *previous, *beforePrevious;
+};
+
+// The cells of diagonal k from i = first to last, one at a time
+template<class Score, class Params>
+static inline void fillCells(const char *s1, const char *r2, int n2, int k, int first, int last,
+                             const Params& params, Diagonals<Score>& d, TracebackMatrix& traceback)
+{
+    if (first > last) return;
+    // The directions are collected in a word and stored when it is full
+    uint32_t *directions = traceback.diagonal(k);
+    int p = first - traceback.first(k);
+    uint32_t word = directions[p / 16] & ((1u << (2 * (p % 16))) - 1);
+    const Score *d2 = d.beforePrevious, *d1 = d.previous;
+    Score *d0 = d.current;
+    const char *c2 = r2 + n2 - k;
+    const int match = params.match_score, mismatch = params.mismatch_penalty, gap = params.gap_penalty;
+    for (int i = first; i <= last; ++i, ++p) {
+        int diagonal = d2[i - 1] + (s1[i - 1] == c2[i] ? match : mismatch);
+        int up = d1[i] + gap;
+        int left = d1[i - 1] + gap;
+        int h = std::max(0, std::max(std::max(diagonal, up), left));
+        d0[i] = h;
+        // The backtrack prefers up, then left, then the diagonal (computed
+        // without branches, as in the vector kernels)
+        uint32_t nonzero = h != 0, isUp = h == up, isLeft = h == left;
+        uint32_t direction = (nonzero & (isUp | !isLeft)) | ((nonzero & !isUp) << 1);
+        word |= direction << (2 * (p % 16));
+        if (p % 16 == 15) {
+            directions[p / 16] = word;
+            word = 0;
+        }
+    }
+    if (p % 16 != 0) directions[p / 16] = word;
+}
+
+// The cells that may lie on an overlap scoring at least minScore. A path
+// through cell (i, j) scores at most match_score for each of the min(i, j)
+// diagonal moves before it, and adds at most match_score for each of the
+// n2 - j rows after it, less a gap for each row beyond the n1 - i columns
+// left (gaps no overlap can afford are never taken). Other cells are left at
+// 0 instead of filled, which changes neither the overlaps that reach
+// minScore nor their backtrack: any path through such a cell scores less.
+// The bound is concave along a diagonal, so the cells of a diagonal are one
+// range, solved for from the linear pieces of the bound.
+class ScoreBound
+{
+public:
+    ScoreBound(int n1, int n2, int minScore, const OverlapperParams& params)
+        : n1(n1), n2(n2), minScore(minScore),
+          bGaps((long long)params.match_score * std::min(n1, n2) + params.gap_penalty > 0)
+    {
+        const int match = params.match_score, gap = params.gap_penalty;
+        bEnabled = minScore > 0 && match > 0 && params.mismatch_penalty <= match && gap < 0;
+        if (!bEnabled) return;
+        bUnreachable = (long long)match * std::min(n1, n2) < minScore;
+        // Below row k / 2 of diagonal k the bound grows by 2 * match_score a
+        // cell, then stays at n2 * match_score while there are enough columns
+        // left. Beyond that, gaps take it down along two lines, whose last
+        // cells reaching minScore move half a cell a diagonal
+        lowest = (minScore + match - 1) / match - n2 + 1;
+        const long long rest = (long long)match * n1 + (long long)gap * (n2 - n1) - minScore;
+        highest[0] = floorDiv(rest, -gap);
+        highest[1] = floorDiv(rest, match - gap);
+    }
+
+    bool enabled() const { return bEnabled; }
+    // No overlap can reach minScore at all
+    bool unreachable() const { return bEnabled && bUnreachable; }
+
+    // The cells [lo, hi] of diagonal k a path to minScore may cross, given
+    // its inner cells [first, last]; lo > hi if there are none
+    void range(int k, int first, int last, int& lo, int& hi) const
+    {
+        lo = (int)std::max<long long>(first, half(lowest + k));
+        long long top = half(n1 - n2 + k);
+        if (bGaps) top = std::max(top, std::min(half(highest[0] + k), half(highest[1] + k)));
+        hi = (int)std::min<long long>(last, top);
+    }
+
+private:
+    static long long floorDiv(long long a, long long b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+    static long long half(long long a) { return floorDiv(a, 2); }
+
+    int n1;
+    int n2;
+    int minScore;
+    bool bGaps;
+    bool bEnabled = false;
+    bool bUnreachable = false;
+    long long lowest = 0;
+    long long highest[2] = { 0, 0 };
+};
+
+static std::atomic<std::size_t> totalCells(0);
+static std::atomic<std::size_t> skippedCells(0);
+
+// Fill the matrix diagonal by diagonal, each by fillDiagonal(k, lo, hi, d)
+// from cell lo to hi: the whole diagonal, or with a bound the cells in its
+// range, widened to whole vectors of width cells from a multiple of width
+// cells into the diagonal, as a scalar tail costs more than the cells it
+// spares. The rest of the diagonal is set to 0
+template<class Score, class FillDiagonal>
+static void fillDiagonals(int n1, int n2, int width, const ScoreBound& bound, AlignmentWorkspace& workspace,
+                          FillDiagonal fillDiagonal)
+{
+    std::size_t cells = (std::size_t)n1 * n2, filled = 0;
+    if (bound.unreachable()) {
+        totalCells += cells;
+        skippedCells += cells;
+        return;
+    }
+
+    Diagonals<Score> d(n1, n2, workspace);
+    TracebackMatrix& traceback = workspace.traceback;
+    std::vector<int>& last_row = workspace.lastRow;
+    for (int k = 2; k <= n1 + n2; ++k) {
+        d.advance(k);
+        int first = traceback.first(k), last = traceback.last(k);
+        int lo = first, hi = last;
+        if (bound.enabled()) {
+            bound.range(k, first, last, lo, hi);
+            if (lo <= hi) {
+                lo = first + (lo - first) / width * width;
+                hi = std::min(last, lo + (hi - lo + width) / width * width - 1);
+            } else {
+                lo = last + 1;
+                hi = last;
+            }
+            for (int i = first; i < lo; ++i) d.current[i] = 0;
+            for (int i = hi + 1; i <= last; ++i) d.current[i] = 0;
+        }
+        if (lo <= hi) {
+            fillDiagonal(k, lo, hi, d);
+            filled += hi - lo + 1;
+        }
+        if (k > n2) last_row[k - n2] = d.current[k - n2];
+    }
+    totalCells += cells;
+    skippedCells += cells - filled;
+}
+
+template<class Score, class Params>
+static void fillScalar(const char *s1, int n1, const char *r2, int n2, const Params& params,
+                       const ScoreBound& bound, AlignmentWorkspace& workspace)
+{
+    TracebackMatrix& traceback = workspace.traceback;
+    fillDiagonals<Score>(n1, n2, 1, bound, workspace, [&](int k, int lo, int hi, Diagonals<Score>& d) {
+        fillCells(s1, r2, n2, k, lo, hi, params, d, traceback);
+    });
+}
+
+#ifdef OVERLAPPER_X86
+
+// The directions of a vector of cells are packed by a byte movemask: the low
+// byte of each 16-bit lane carries bit 0 of the direction, the high byte bit 1.
+// The vectors of a diagonal start a multiple of 8 cells into it
+template<class Params>
+__attribute__((target("sse4.1")))
+static void diagonalSSE41(const char *s1, const char *r2, int n2, int k, int lo, int hi, const Params& params,
+                          Diagonals<int16_t>& d, TracebackMatrix& traceback)
+{
+    const __m128i vMatch = _mm_set1_epi16(params.match_score);
+    const __m128i vMismatch = _mm_set1_epi16(params.mismatch_penalty);
+    const __m128i vGap = _mm_set1_epi16(params.gap_penalty);
+    const __m128i vZero = _mm_setzero_si128();
+    const __m128i vOnes = _mm_set1_epi16(-1);
+    const __m128i vLow = _mm_set1_epi16(0x00ff);
+
+    int first = traceback.first(k);
+    char *directions = (char *)traceback.diagonal(k);
+    int i = lo;
+    for (; i + 8 <= hi + 1; i += 8) {
+        __m128i a = _mm_loadl_epi64((const __m128i *)(s1 + i - 1));
+        __m128i b = _mm_loadl_epi64((const __m128i *)(r2 + (n2 - k + i)));
+        __m128i eq = _mm_cvtepi8_epi16(_mm_cmpeq_epi8(a, b));
+        __m128i sub = _mm_blendv_epi8(vMismatch, vMatch, eq);
+        __m128i diagonal = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(d.beforePrevious + i - 1)), sub);
+        __m128i up = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(d.previous + i)), vGap);
+        __m128i left = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(d.previous + i - 1)), vGap);
+        __m128i h = _mm_max_epi16(_mm_max_epi16(diagonal, up), _mm_max_epi16(left, vZero));
+        _mm_storeu_si128((__m128i *)(d.current + i), h);
+
+        __m128i isZero = _mm_cmpeq_epi16(h, vZero);
+        __m128i isUp = _mm_cmpeq_epi16(h, up);
+        __m128i isLeft = _mm_cmpeq_epi16(h, left);
+        __m128i bit0 = _mm_andnot_si128(isZero, _mm_or_si128(isUp, _mm_andnot_si128(isLeft, vOnes)));
+        __m128i bit1 = _mm_andnot_si128(_mm_or_si128(isZero, isUp), vOnes);
+        __m128i bits = _mm_or_si128(_mm_and_si128(bit0, vLow), _mm_andnot_si128(vLow, bit1));
+        uint16_t mask = (uint16_t)_mm_movemask_epi8(bits);
+        memcpy(directions + (i - first) / 4, &mask, sizeof(mask));
+    }
+    fillCells(s1, r2, n2, k, i, hi, params, d, traceback);
+}
+
+// The vectors of a diagonal start a multiple of 16 cells into it
+template<class Params>
+__attribute__((target("avx2")))
+static void diagonalAVX2(const char *s1, const char *r2, int n2, int k, int lo, int hi, const Params& params,
+                         Diagonals<int16_t>& d, TracebackMatrix& traceback)
+{
+    const __m256i vMatch = _mm256_set1_epi16(params.match_score);
+    const __m256i vMismatch = _mm256_set1_epi16(params.mismatch_penalty);
+    const __m256i vGap = _mm256_set1_epi16(params.gap_penalty);
+    const __m256i vZero = _mm256_setzero_si256();
+    const __m256i vOnes = _mm256_set1_epi16(-1);
+    const __m256i vLow = _mm256_set1_epi16(0x00ff);
+
+    int first = traceback.first(k);
+    uint32_t *directions = traceback.diagonal(k);
+    int i = lo;
+    for (; i + 16 <= hi + 1; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s1 + i - 1));
+        __m128i b = _mm_loadu_si128((const __m128i *)(r2 + (n2 - k + i)));
+        __m256i eq = _mm256_cvtepi8_epi16(_mm_cmpeq_epi8(a, b));
+        __m256i sub = _mm256_blendv_epi8(vMismatch, vMatch, eq);
+        __m256i diagonal = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(d.beforePrevious + i - 1)), sub);
+        __m256i up = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(d.previous + i)), vGap);
+        __m256i left = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(d.previous + i - 1)), vGap);
+        __m256i h = _mm256_max_epi16(_mm256_max_epi16(diagonal, up), _mm256_max_epi16(left, vZero));
+        _mm256_storeu_si256((__m256i *)(d.current + i), h);
+
+        __m256i isZero = _mm256_cmpeq_epi16(h, vZero);
+        __m256i isUp = _mm256_cmpeq_epi16(h, up);
+        __m256i isLeft = _mm256_cmpeq_epi16(h, left);
+        __m256i bit0 = _mm256_andnot_si256(isZero, _mm256_or_si256(isUp, _mm256_andnot_si256(isLeft, vOnes)));
+        __m256i bit1 = _mm256_andnot_si256(_mm256_or_si256(isZero, isUp), vOnes);
+        __m256i bits = _mm256_or_si256(_mm256_and_si256(bit0, vLow), _mm256_andnot_si256(vLow, bit1));
+        directions[(i - first) / 16] = (uint32_t)_mm256_movemask_epi8(bits);
+    }
+    fillCells(s1, r2, n2, k, i, hi, params, d, traceback);
+}
+
+template<class Params>
+static void fillSSE41(const char *s1, int n1, const char *r2, int n2, const Params& params,
+                      const ScoreBound& bound, AlignmentWorkspace& workspace)
+{
+    TracebackMatrix& traceback = workspace.traceback;
+    fillDiagonals<int16_t>(n1, n2, 8, bound, workspace, [&](int k, int lo, int hi, Diagonals<int16_t>& d) {
+        diagonalSSE41(s1, r2, n2, k, lo, hi, params, d, traceback);
+    });
+}
+
+template<class Params>
+static void fillAVX2(const char *s1, int n1, const char *r2, int n2, const Params& params,
+                     const ScoreBound& bound, AlignmentWorkspace& workspace)
+{
+    TracebackMatrix& traceback = workspace.traceback;
+    fillDiagonals<int16_t>(n1, n2, 16, bound, workspace, [&](int k, int lo, int hi, Diagonals<int16_t>& d) {
+        diagonalAVX2(s1, r2, n2, k, lo, hi, params, d, traceback);
+    });
+}
+
+#endif
+
+static bool fits16(int n1, int n2, const OverlapperParams& params)
+{
+    const int lowest = std::numeric_limits<int16_t>::min();
+    const int highest = std::numeric_limits<int16_t>::max();
+    return params.match_score >= 0
+            && (long long)params.match_score * std::min(n1, n2) <= highest
+            && params.gap_penalty >= lowest && params.mismatch_penalty >= lowest;
+}
+
+// The fill for one parameter type, for dispatchParams
+struct FillSW2
+{
+    typedef void result_type;
+    const char *s1;
+    int n1;
+    const char *r2;
+    int n2;
+    Level level;
+    const ScoreBound& bound;
+    AlignmentWorkspace& workspace;
+
+    template<class Params>
+    void operator()(const Params& params) const
+    {
+#ifdef OVERLAPPER_X86
+        if (level == AVX2) return fillAVX2(s1, n1, r2, n2, params, bound, workspace);
+        if (level == SSE41) return fillSSE41(s1, n1, r2, n2, params, bound, workspace);
+#endif
+        fillScalar<int>(s1, n1, r2, n2, params, bound, workspace);
+    }
+};
+
+void fillSW2(const char *s1, int n1, const char *s2, int n2, const OverlapperParams &params,
+             AlignmentWorkspace &workspace, int minScore)
+{
+    // s2 reversed, so that the rows of a diagonal are contiguous as well
+    char *r2 = workspace.buffer<char>(0, n2);
+    std::reverse_copy(s2, s2 + n2, r2);
+
+    workspace.traceback.resize(n1, n2);
+    workspace.lastRow.assign(n1 + 1, 0);
+
+    ScoreBound bound(n1, n2, minScore, params);
+    FillSW2 fill = { s1, n1, r2, n2, fits16(n1, n2, params) ? level() : SCALAR, bound, workspace };
+    dispatchParams(params, fill);
+}
+
+std::size_t getTotalCells()
+{
+    return totalCells.load();
+}
+
+std::size_t getSkippedCells()
+{
+    return skippedCells.load();
+}
+
+}
@@ -0,0 +1,42 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_simd - Vectorized fill of the computeOverlapSW2 matrix
+//
+// ------------------------------------------------------------------------------
+#ifndef OVERLAPPER_SIMD_H
+#define OVERLAPPER_SIMD_H
+
+#include "overlapper.h"
+#include "overlapper_workspace.h"
+
+namespace OverlapperSIMD
+{
+
+enum Level { SCALAR = 0, SSE41, AVX2 };
+
+// The best level supported by the CPU, capped by setMaxLevel
+Level level();
+const char *levelName(Level level);
+
+// Never use more than maxLevel, e.g. to compare the kernels
+void setMaxLevel(Level maxLevel);
+
+// Fill the computeOverlapSW2 matrix, keeping only the traceback and the last
+// row (workspace.lastRow[i] is the score of cell (i, n2), lastRow[0] is 0).
+// Uses 16-bit lanes if a vector kernel is available and the scores fit, the
+// scalar fill otherwise. The directions are exactly those of the scalar
+// recurrence.
+// With a positive minScore, cells that no path to a last row score
+// of minScore can cross are skipped: last row scores of at least minScore
+// and the traceback from them are as without it, lower scores may drop.
+void fillSW2(const char *s1, int n1, const char *s2, int n2, const OverlapperParams& params,
+             AlignmentWorkspace& workspace, int minScore = 0);
+
+// The cells of the matrices filled so far over all threads, and how many of
+// them the bound on minScore skipped
+std::size_t getTotalCells();
+std::size_t getSkippedCells();
+
+}
+
+#endif
@@ -0,0 +1,702 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_ungapped - computeOverlapSW2 for scoring schemes without gaps
+//
+// If a gap can never pay off (gap + match * min(n1, n2) <= 0), no cell of the
+// computeOverlapSW2 matrix is ever reached by an up or left move, and the
+// recurrence becomes H(i, j) = max(0, H(i - 1, j - 1) + s(i, j)) along each
+// diagonal. Only the last row is needed to pick the endpoints, so the
+// diagonals are scanned side by side, a vector of diagonals per row of s2,
+// keeping nothing but the current value of each diagonal. The few diagonals
+// that are backtracked are rescanned on their own.
+//
+// computeOverlapBatch scans many pairs instead, a lane per pair, which keeps
+// all lanes busy however short the sequences are.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper.h"
+#include "overlapper_simd.h"
+#include "../error.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OVERLAPPER_X86 1
+#include <immintrin.h>
+#endif
+
+// Lane k scans the diagonal ending in the last row at i = k + 1. padded holds
+// s1 behind n2 sentinel bytes that match nothing in s2 and in front of at least
+// 16 more, so that row j of lane k compares s2[j - 1] with padded[k + j], and
+// cells left of the matrix stay 0.
+
+template<class Params>
+static void scanScalar(const char *padded, int n1, const char *s2, int n2, const Params& params, int *last)
+{
+    for (int lane = 0; lane < n1; ++lane) {
+        int h = 0;
+        for (int j = 1; j <= n2; ++j) {
+            h += padded[lane + j] == s2[j - 1] ? params.match_score : params.mismatch_penalty;
+            if (h < 0) h = 0;
+        }
+        last[lane] = h;
+    }
+}
+
+#ifdef OVERLAPPER_X86
+
+template<class Params>
+__attribute__((target("sse4.1")))
+static void scanSSE41(const char *padded, int n1, const char *s2, int n2, const Params& params, int *last)
+{
+    const __m128i vMatch = _mm_set1_epi16(params.match_score);
+    const __m128i vMismatch = _mm_set1_epi16(params.mismatch_penalty);
+    const __m128i vZero = _mm_setzero_si128();
+    for (int lane = 0; lane < n1; lane += 8) {
+        const char *p = padded + lane;
+        __m128i h = vZero;
+        for (int j = 1; j <= n2; ++j) {
+            __m128i a = _mm_loadl_epi64((const __m128i *)(p + j));
+            __m128i eq = _mm_cvtepi8_epi16(_mm_cmpeq_epi8(a, _mm_set1_epi8(s2[j - 1])));
+            h = _mm_max_epi16(_mm_adds_epi16(h, _mm_blendv_epi8(vMismatch, vMatch, eq)), vZero);
+        }
+        int16_t out[8];
+        _mm_storeu_si128((__m128i *)out, h);
+        std::copy(out, out + std::min(8, n1 - lane), last + lane);
+    }
+}
+
+template<class Params>
+__attribute__((target("avx2")))
+static void scanAVX2(const char *padded, int n1, const char *s2, int n2, const Params& params, int *last)
+{
+    const __m256i vMatch = _mm256_set1_epi16(params.match_score);
+    const __m256i vMismatch = _mm256_set1_epi16(params.mismatch_penalty);
+    const __m256i vZero = _mm256_setzero_si256();
+    for (int lane = 0; lane < n1; lane += 16) {
+        const char *p = padded + lane;
+        __m256i h = vZero;
+        for (int j = 1; j <= n2; ++j) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(p + j));
+            __m256i eq = _mm256_cvtepi8_epi16(_mm_cmpeq_epi8(a, _mm_set1_epi8(s2[j - 1])));
+            h = _mm256_max_epi16(_mm256_adds_epi16(h, _mm256_blendv_epi8(vMismatch, vMatch, eq)), vZero);
+        }
+        int16_t out[16];
+        _mm256_storeu_si256((__m256i *)out, h);
+        std::copy(out, out + std::min(16, n1 - lane), last + lane);
+    }
+}
+
+#endif
+
+// The scan for one parameter type, for dispatchParams
+struct ScanLastRow
+{
+    typedef void result_type;
+    const char *padded;
+    int n1;
+    const char *s2;
+    int n2;
+    OverlapperSIMD::Level level;
+    int *last;
+
+    template<class Params>
+    void operator()(const Params& params) const
+    {
+#ifdef OVERLAPPER_X86
+        if (level == OverlapperSIMD::AVX2) return scanAVX2(padded, n1, s2, n2, params, last);
+        if (level == OverlapperSIMD::SSE41) return scanSSE41(padded, n1, s2, n2, params, last);
+#endif
+        scanScalar(padded, n1, s2, n2, params, last);
+    }
+};
+
+// Try the endpoints of workspace.lastRow in the order of computeOverlapSW2:
+// rescan the diagonal of each, then walk back while the score is positive.
+// False if none qualifies; a batch has no use for the exception
+static bool backtrackUngapped(const char *s1, int n1, const char *s2, int n2, int minOverlap, double minIdentity,
+                              const OverlapperParams& params, AlignmentWorkspace& workspace, SequenceOverlap& output)
+{
+    const std::vector<int>& last_row = workspace.lastRow;
+    if (*std::max_element(last_row.begin(), last_row.end()) < Overlapper::minQualifiedScore(n1, n2, minOverlap, minIdentity, params))
+        return false;
+    std::vector<size_t>& last_row_indexes = workspace.endpoints;
+    Overlapper::selectEndpoints(last_row, 10, last_row_indexes);
+
+    int *scores = workspace.buffer<int>(1, n2 + 1);
+    for (auto max_row_index: last_row_indexes) {
+        int d = max_row_index - n2;
+        int first = std::max(1, 1 - d);
+        scores[first - 1] = 0;
+        for (int j = first; j <= n2; ++j)
+            scores[j] = std::max(0, scores[j - 1] + (s1[j + d - 1] == s2[j - 1] ? params.match_score : params.mismatch_penalty));
+
+        output.score = last_row[max_row_index];
+        output.match[0].end = max_row_index - 1;
+        output.match[1].end = n2 - 1;
+        output.length[0] = n1;
+        output.length[1] = n2;
+        output.edit_distance = 0;
+        output.total_columns = 0;
+
+        int j = n2;
+        while (j >= first && scores[j] > 0) {
+            if (s1[j + d - 1] != s2[j - 1]) output.edit_distance += 1;
+            output.total_columns += 1;
+            j--;
+        }
+        output.match[0].start = j + d;
+        output.match[1].start = j;
+        output.cigar = std::to_string(output.total_columns) + "M";
+
+        if (output.isQualified(minOverlap, minIdentity))
+            return true;
+    }
+    return false;
+}
+
+bool Overlapper::isUngapped(int n1, int n2, const OverlapperParams& params)
+{
+    const int highest = std::numeric_limits<int16_t>::max();
+    long long best = (long long)params.match_score * std::min(n1, n2);
+    return params.match_score >= 0 && params.mismatch_penalty <= 0
+            && params.mismatch_penalty >= std::numeric_limits<int16_t>::min()
+            && best <= highest && best + params.gap_penalty <= 0;
+}
+
+SequenceOverlap Overlapper::computeOverlapUngapped(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    SequenceOverlap output;
+    if (!findOverlapUngapped(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace))
+        error("No overlap was found.");
+    return output;
+}
+
+bool Overlapper::findOverlapUngapped(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace)
+{
+    if(n1 == 0 || n2 == 0) {
+        std::cerr << "Overlapper::computeOverlapSW error: empty input sequence\n";
+        exit(EXIT_FAILURE);
+    }
+    if (!isUngapped(n1, n2, params))
+        return findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace);
+
+    // A sentinel byte that does not occur in s2
+    bool used[256] = { false };
+    for (int j = 0; j < n2; ++j) used[(unsigned char)s2[j]] = true;
+    int sentinel = 0;
+    while (sentinel < 256 && used[sentinel]) sentinel++;
+    if (sentinel == 256)
+        return findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace);
+
+    char *padded = workspace.buffer<char>(0, n2 + n1 + 32);
+    std::fill(padded, padded + n2, (char)sentinel);
+    std::copy(s1, s1 + n1, padded + n2);
+    std::fill(padded + n2 + n1, padded + n2 + n1 + 32, (char)sentinel);
+
+    // The last row of the matrix, H(i, n2) for i = 1..n1
+    std::vector<int>& last_row = workspace.lastRow;
+    last_row.assign(n1 + 1, 0);
+    ScanLastRow scan = { padded, n1, s2, n2, OverlapperSIMD::level(), last_row.data() + 1 };
+    dispatchParams(params, scan);
+
+    return backtrackUngapped(s1, n1, s2, n2, minOverlap, minIdentity, params, workspace, output);
+}
+
+// Batches: lane p of a vector scans a diagonal of pair p instead. The
+// sequences of a group of pairs are interleaved byte by byte, one byte per
+// lane at each position: s1s holds the padded s1 of every pair and s2s every
+// s2, each behind bytes that match nothing, so that the s2 of all pairs end
+// in the same row and the s1 of all pairs start at the same position
+// (padded from n2 on). Row j of diagonal d compares s2s position j - 1 with
+// s1s position d + j; the rows in front of a shorter s2 only ever score 0.
+// Lane p of last[d] is then the score of pair p in the last row at i = d + 1.
+//
+// The scores of short reads fit in unsigned bytes, which doubles the lanes:
+// a match adds and a mismatch subtracts with saturation at 0, which is the
+// max(0, h + s) of the recurrence as long as no score can reach 255.
+
+template<class Params>
+static void scanBatchScalar(const char *s1s, const char *s2s, int lanes, int n1, int n2, const Params& params, int16_t *last)
+{
+    for (int d = 0; d < n1; ++d) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            int h = 0;
+            for (int j = 1; j <= n2; ++j) {
+                h += s1s[(d + j) * lanes + lane] == s2s[(j - 1) * lanes + lane] ? params.match_score : params.mismatch_penalty;
+                if (h < 0) h = 0;
+            }
+            last[d * lanes + lane] = h;
+        }
+    }
+}
+
+#ifdef OVERLAPPER_X86
+
+// One row of a diagonal for every lane: 8 lanes of 16 bits, 16 of 8 bits
+struct StepSSE41
+{
+    static const int LANES = 8;
+
+    __attribute__((target("sse4.1")))
+    StepSSE41(int match, int mismatch) : vMatch(_mm_set1_epi16(match)), vMismatch(_mm_set1_epi16(mismatch)) {}
+
+    __attribute__((target("sse4.1")))
+    __m128i operator()(__m128i h, const char *a, const char *b) const
+    {
+        __m128i eq = _mm_cvtepi8_epi16(_mm_cmpeq_epi8(_mm_loadl_epi64((const __m128i *)a), _mm_loadl_epi64((const __m128i *)b)));
+        return _mm_max_epi16(_mm_adds_epi16(h, _mm_blendv_epi8(vMismatch, vMatch, eq)), _mm_setzero_si128());
+    }
+
+    __attribute__((target("sse4.1")))
+    static void store(int16_t *out, __m128i h) { _mm_store_si128((__m128i *)out, h); }
+
+    __m128i vMatch, vMismatch;
+};
+
+struct Step8SSE41
+{
+    static const int LANES = 16;
+
+    __attribute__((target("sse4.1")))
+    Step8SSE41(int match, int mismatch) : vMatch(_mm_set1_epi8(match)), vMismatch(_mm_set1_epi8(-mismatch)) {}
+
+    __attribute__((target("sse4.1")))
+    __m128i operator()(__m128i h, const char *a, const char *b) const
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)a), _mm_load_si128((const __m128i *)b));
+        return _mm_subs_epu8(_mm_adds_epu8(h, _mm_and_si128(eq, vMatch)), _mm_andnot_si128(eq, vMismatch));
+    }
+
+    __attribute__((target("sse4.1")))
+    static void store(int16_t *out, __m128i h)
+    {
+        _mm_store_si128((__m128i *)out, _mm_cvtepu8_epi16(h));
+        _mm_store_si128((__m128i *)(out + 8), _mm_cvtepu8_epi16(_mm_srli_si128(h, 8)));
+    }
+
+    __m128i vMatch, vMismatch;
+};
+
+// Four diagonals at a time, which share the bytes of s2 and keep four
+// independent chains of additions in flight
+template<class Step>
+__attribute__((target("sse4.1")))
+static void scanBatchSSE41(const char *s1s, const char *s2s, int n1, int n2, const Step& step, int16_t *last)
+{
+    const int lanes = Step::LANES;
+    int d = 0;
+    for (; d + 4 <= n1; d += 4) {
+        __m128i h0 = _mm_setzero_si128(), h1 = h0, h2 = h0, h3 = h0;
+        for (int j = 1; j <= n2; ++j) {
+            const char *a = s1s + (d + j) * lanes, *b = s2s + (j - 1) * lanes;
+            h0 = step(h0, a, b);
+            h1 = step(h1, a + lanes, b);
+            h2 = step(h2, a + 2 * lanes, b);
+            h3 = step(h3, a + 3 * lanes, b);
+        }
+        Step::store(last + d * lanes, h0);
+        Step::store(last + (d + 1) * lanes, h1);
+        Step::store(last + (d + 2) * lanes, h2);
+        Step::store(last + (d + 3) * lanes, h3);
+    }
+    for (; d < n1; ++d) {
+        __m128i h = _mm_setzero_si128();
+        for (int j = 1; j <= n2; ++j)
+            h = step(h, s1s + (d + j) * lanes, s2s + (j - 1) * lanes);
+        Step::store(last + d * lanes, h);
+    }
+}
+
+// 16 lanes of 16 bits, 32 of 8 bits
+struct StepAVX2
+{
+    static const int LANES = 16;
+
+    __attribute__((target("avx2")))
+    StepAVX2(int match, int mismatch) : vMatch(_mm256_set1_epi16(match)), vMismatch(_mm256_set1_epi16(mismatch)) {}
+
+    __attribute__((target("avx2")))
+    __m256i operator()(__m256i h, const char *a, const char *b) const
+    {
+        __m256i eq = _mm256_cvtepi8_epi16(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)a), _mm_load_si128((const __m128i *)b)));
+        return _mm256_max_epi16(_mm256_adds_epi16(h, _mm256_blendv_epi8(vMismatch, vMatch, eq)), _mm256_setzero_si256());
+    }
+
+    __attribute__((target("avx2")))
+    static void store(int16_t *out, __m256i h) { _mm256_store_si256((__m256i *)out, h); }
+
+    __m256i vMatch, vMismatch;
+};
+
+struct Step8AVX2
+{
+    static const int LANES = 32;
+
+    __attribute__((target("avx2")))
+    Step8AVX2(int match, int mismatch) : vMatch(_mm256_set1_epi8(match)), vMismatch(_mm256_set1_epi8(-mismatch)) {}
+
+    __attribute__((target("avx2")))
+    __m256i operator()(__m256i h, const char *a, const char *b) const
+    {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)a), _mm256_load_si256((const __m256i *)b));
+        return _mm256_subs_epu8(_mm256_adds_epu8(h, _mm256_and_si256(eq, vMatch)), _mm256_andnot_si256(eq, vMismatch));
+    }
+
+    __attribute__((target("avx2")))
+    static void store(int16_t *out, __m256i h)
+    {
+        _mm256_store_si256((__m256i *)out, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(h)));
+        _mm256_store_si256((__m256i *)(out + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(h, 1)));
+    }
+
+    __m256i vMatch, vMismatch;
+};
+
+template<class Step>
+__attribute__((target("avx2")))
+static void scanBatchAVX2(const char *s1s, const char *s2s, int n1, int n2, const Step& step, int16_t *last)
+{
+    const int lanes = Step::LANES;
+    int d = 0;
+    for (; d + 4 <= n1; d += 4) {
+        __m256i h0 = _mm256_setzero_si256(), h1 = h0, h2 = h0, h3 = h0;
+        for (int j = 1; j <= n2; ++j) {
+            const char *a = s1s + (d + j) * lanes, *b = s2s + (j - 1) * lanes;
+            h0 = step(h0, a, b);
+            h1 = step(h1, a + lanes, b);
+            h2 = step(h2, a + 2 * lanes, b);
+            h3 = step(h3, a + 3 * lanes, b);
+        }
+        Step::store(last + d * lanes, h0);
+        Step::store(last + (d + 1) * lanes, h1);
+        Step::store(last + (d + 2) * lanes, h2);
+        Step::store(last + (d + 3) * lanes, h3);
+    }
+    for (; d < n1; ++d) {
+        __m256i h = _mm256_setzero_si256();
+        for (int j = 1; j <= n2; ++j)
+            h = step(h, s1s + (d + j) * lanes, s2s + (j - 1) * lanes);
+        Step::store(last + d * lanes, h);
+    }
+}
+
+#endif
+
+// The number of lanes of the batch scan, with scores of 8 or 16 bits
+static int batchLanes(bool bBytes)
+{
+    switch (OverlapperSIMD::level()) {
+    case OverlapperSIMD::AVX2: return bBytes ? 32 : 16;
+    case OverlapperSIMD::SSE41: return bBytes ? 16 : 8;
+    default: return 1;
+    }
+}
+
+// True if the scores of the pair fit in unsigned bytes
+static bool fitsBytes(const OverlapPair& pair, const OverlapperParams& params)
+{
+    return (long long)params.match_score * std::min(pair.n1, pair.n2) < 255 && params.mismatch_penalty >= -255;
+}
+
+// The batch scan for one parameter type, for dispatchParams
+struct ScanBatch
+{
+    typedef void result_type;
+    const char *s1s;
+    const char *s2s;
+    int lanes;
+    bool bBytes;
+    int n1;
+    int n2;
+    int16_t *last;
+
+    template<class Params>
+    void operator()(const Params& params) const
+    {
+#ifdef OVERLAPPER_X86
+        const int match = params.match_score, mismatch = params.mismatch_penalty;
+        if (lanes == 32) return scanBatchAVX2(s1s, s2s, n1, n2, Step8AVX2(match, mismatch), last);
+        if (lanes == 16 && bBytes) return scanBatchSSE41(s1s, s2s, n1, n2, Step8SSE41(match, mismatch), last);
+        if (lanes == 16) return scanBatchAVX2(s1s, s2s, n1, n2, StepAVX2(match, mismatch), last);
+        if (lanes == 8) return scanBatchSSE41(s1s, s2s, n1, n2, StepSSE41(match, mismatch), last);
+#endif
+        scanBatchScalar(s1s, s2s, lanes, n1, n2, params, last);
+    }
+};
+
+// Two bytes that occur in neither sequence of a pair, to pad s1 and s2 with;
+// false if there are no two
+static bool findSentinels(const OverlapPair& pair, char& sentinel1, char& sentinel2)
+{
+    bool used[256] = { false };
+    for (int i = 0; i < pair.n1; ++i) used[(unsigned char)pair.s1[i]] = true;
+    for (int j = 0; j < pair.n2; ++j) used[(unsigned char)pair.s2[j]] = true;
+    int found = 0;
+    for (int c = 0; c < 256 && found < 2; ++c) {
+        if (used[c]) continue;
+        (found++ == 0 ? sentinel1 : sentinel2) = (char)c;
+    }
+    return found == 2;
+}
+
+// Scan the pairs of indexes side by side, a group of lanes at a time, and
+// backtrack each on its own
+static void overlapBatched(const std::vector<OverlapPair>& pairs, std::vector<size_t>& indexes, bool bBytes,
+                           int minOverlap, double minIdentity, const OverlapperParams& params,
+                           std::vector<SequenceOverlap>& overlaps, std::vector<bool>& found, AlignmentWorkspace& workspace)
+{
+    // Pairs of about the same length share a group, so that few lanes idle
+    // in the rows and diagonals of the longest
+    std::stable_sort(indexes.begin(), indexes.end(), [&pairs](size_t a, size_t b) {
+        return pairs[a].n1 < pairs[b].n1 || (pairs[a].n1 == pairs[b].n1 && pairs[a].n2 < pairs[b].n2);
+    });
+
+    const int lanes = batchLanes(bBytes);
+    for (size_t first = 0; first < indexes.size(); first += lanes) {
+        const size_t count = std::min(indexes.size() - first, (size_t)lanes);
+        // A group costs the same however few of its lanes are used
+        if (count * 4 < (size_t)lanes) {
+            for (size_t lane = 0; lane < count; ++lane) {
+                const size_t p = indexes[first + lane];
+                const OverlapPair& pair = pairs[p];
+                found[p] = Overlapper::findOverlapUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, overlaps[p], workspace);
+            }
+            continue;
+        }
+        int n1 = 0, n2 = 0;
+        for (size_t lane = 0; lane < count; ++lane) {
+            n1 = std::max(n1, pairs[indexes[first + lane]].n1);
+            n2 = std::max(n2, pairs[indexes[first + lane]].n2);
+        }
+
+        // Unused lanes compare two different bytes throughout
+        char *s1s = workspace.buffer<char>(4, (size_t)(n2 + n1) * lanes);
+        char *s2s = workspace.buffer<char>(5, (size_t)n2 * lanes);
+        std::fill(s1s, s1s + (size_t)(n2 + n1) * lanes, 0);
+        std::fill(s2s, s2s + (size_t)n2 * lanes, 1);
+        for (size_t lane = 0; lane < count; ++lane) {
+            const OverlapPair& pair = pairs[indexes[first + lane]];
+            char sentinel1, sentinel2;
+            findSentinels(pair, sentinel1, sentinel2);
+            for (int x = 0; x < n2 + n1; ++x) {
+                int i = x - n2;
+                s1s[(size_t)x * lanes + lane] = i >= 0 && i < pair.n1 ? pair.s1[i] : sentinel1;
+            }
+            for (int j = 0; j < n2; ++j) {
+                int k = j - (n2 - pair.n2);
+                s2s[(size_t)j * lanes + lane] = k >= 0 ? pair.s2[k] : sentinel2;
+            }
+        }
+
+        int16_t *last = workspace.buffer<int16_t>(6, (size_t)n1 * lanes);
+        ScanBatch scan = { s1s, s2s, lanes, bBytes, n1, n2, last };
+        dispatchParams(params, scan);
+
+        for (size_t lane = 0; lane < count; ++lane) {
+            const size_t p = indexes[first + lane];
+            const OverlapPair& pair = pairs[p];
+            std::vector<int>& last_row = workspace.lastRow;
+            last_row.assign(pair.n1 + 1, 0);
+            for (int d = 0; d < pair.n1; ++d)
+                last_row[d + 1] = last[(size_t)d * lanes + lane];
+            found[p] = backtrackUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, workspace, overlaps[p]);
+        }
+    }
+}
+
+int Overlapper::batchWidth()
+{
+    return batchLanes(true);
+}
+
+std::vector<SequenceOverlap> Overlapper::computeOverlapBatch(const std::vector<OverlapPair>& pairs, int minOverlap, double minIdentity, std::vector<bool>& found, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    std::vector<SequenceOverlap> overlaps(pairs.size());
+    found.assign(pairs.size(), false);
+
+    // The pairs whose scores fit in bytes, the other pairs the ungapped
+    // kernel can take, and the rest, which go one at a time
+    std::vector<size_t> bytes, words;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        const OverlapPair& pair = pairs[p];
+        char sentinel1, sentinel2;
+        if (batchLanes(false) > 1 && pair.n1 > 0 && pair.n2 > 0 && isUngapped(pair.n1, pair.n2, params)
+                && findSentinels(pair, sentinel1, sentinel2)) {
+            (fitsBytes(pair, params) ? bytes : words).push_back(p);
+            continue;
+        }
+        found[p] = Overlapper::findOverlapUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, overlaps[p], workspace);
+    }
+    overlapBatched(pairs, bytes, true, minOverlap, minIdentity, params, overlaps, found, workspace);
+    overlapBatched(pairs, words, false, minOverlap, minIdentity, params, overlaps, found, workspace);
+    return overlaps;
+}
+
+// Profiles: the scores of a read against a target come from the rows of the
+// profile, so the scan adds a loaded vector instead of comparing bases.
+// rows[j - 1] points at the scores of s2[j - 1] such that rows[j - 1][k] is
+// the score of row j on diagonal k of the part of the target aligned. Row j
+// of diagonal k lies left of that part if j < n2 - k; those cells are kept
+// at 0 like the cells left of the matrix.
+
+OverlapProfile::OverlapProfile(const char *s1, int n1, int maxReadLength, const OverlapperParams& params)
+    : s1(s1), n1(n1), padding(std::max(maxReadLength, 0)), params(params), width(padding + n1 + 16)
+{
+    const int lowest = std::numeric_limits<int16_t>::min(), highest = std::numeric_limits<int16_t>::max();
+    const int16_t match = std::max(lowest, std::min(highest, params.match_score));
+    const int16_t mismatch = std::max(lowest, std::min(highest, params.mismatch_penalty));
+
+    // Row 0 is for the bytes that do not occur in s1, one more row for each that does
+    std::fill(rowOf, rowOf + 256, 0);
+    std::size_t rows = 1;
+    for (int i = 0; i < n1; ++i) {
+        if (rowOf[(unsigned char)s1[i]] == 0)
+            rowOf[(unsigned char)s1[i]] = rows++;
+    }
+    scores.assign(rows * width, mismatch);
+    for (int i = 0; i < n1; ++i)
+        scores[rowOf[(unsigned char)s1[i]] * width + padding + i] = match;
+}
+
+static void scanProfileScalar(const int16_t *const *rows, int n1, int n2, int *last)
+{
+    for (int k = 0; k < n1; ++k) {
+        int h = 0;
+        for (int j = std::max(1, n2 - k); j <= n2; ++j)
+            h = std::max(0, h + rows[j - 1][k]);
+        last[k] = h;
+    }
+}
+
+#ifdef OVERLAPPER_X86
+
+__attribute__((target("sse4.1")))
+static void scanProfileSSE41(const int16_t *const *rows, int n1, int n2, int *last)
+{
+    const __m128i vZero = _mm_setzero_si128();
+    const __m128i vLanes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    int16_t out[32];
+    int k = 0;
+    // Diagonals with cells left of the target: row j counts from n2 - k on
+    for (; k < n1 && k < n2; k += 8) {
+        __m128i vFirst = _mm_sub_epi16(_mm_set1_epi16(n2 - 1 - k), vLanes);
+        __m128i h = vZero;
+        for (int j = std::max(1, n2 - k - 7); j <= n2; ++j) {
+            __m128i valid = _mm_cmpgt_epi16(_mm_set1_epi16(j), vFirst);
+            __m128i s = _mm_loadu_si128((const __m128i *)(rows[j - 1] + k));
+            h = _mm_and_si128(_mm_max_epi16(_mm_adds_epi16(h, s), vZero), valid);
+        }
+        _mm_storeu_si128((__m128i *)out, h);
+        std::copy(out, out + std::min(8, n1 - k), last + k);
+    }
+    // Four vectors at a time, for independent chains of additions
+    for (; k + 32 <= n1; k += 32) {
+        __m128i h0 = vZero, h1 = vZero, h2 = vZero, h3 = vZero;
+        for (int j = 1; j <= n2; ++j) {
+            const int16_t *s = rows[j - 1] + k;
+            h0 = _mm_max_epi16(_mm_adds_epi16(h0, _mm_loadu_si128((const __m128i *)s)), vZero);
+            h1 = _mm_max_epi16(_mm_adds_epi16(h1, _mm_loadu_si128((const __m128i *)(s + 8))), vZero);
+            h2 = _mm_max_epi16(_mm_adds_epi16(h2, _mm_loadu_si128((const __m128i *)(s + 16))), vZero);
+            h3 = _mm_max_epi16(_mm_adds_epi16(h3, _mm_loadu_si128((const __m128i *)(s + 24))), vZero);
+        }
+        _mm_storeu_si128((__m128i *)out, h0);
+        _mm_storeu_si128((__m128i *)(out + 8), h1);
+        _mm_storeu_si128((__m128i *)(out + 16), h2);
+        _mm_storeu_si128((__m128i *)(out + 24), h3);
+        std::copy(out, out + 32, last + k);
+    }
+    for (; k < n1; k += 8) {
+        __m128i h = vZero;
+        for (int j = 1; j <= n2; ++j)
+            h = _mm_max_epi16(_mm_adds_epi16(h, _mm_loadu_si128((const __m128i *)(rows[j - 1] + k))), vZero);
+        _mm_storeu_si128((__m128i *)out, h);
+        std::copy(out, out + std::min(8, n1 - k), last + k);
+    }
+}
+
+__attribute__((target("avx2")))
+static void scanProfileAVX2(const int16_t *const *rows, int n1, int n2, int *last)
+{
+    const __m256i vZero = _mm256_setzero_si256();
+    const __m256i vLanes = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int16_t out[64];
+    int k = 0;
+    for (; k < n1 && k < n2; k += 16) {
+        __m256i vFirst = _mm256_sub_epi16(_mm256_set1_epi16(n2 - 1 - k), vLanes);
+        __m256i h = vZero;
+        for (int j = std::max(1, n2 - k - 15); j <= n2; ++j) {
+            __m256i valid = _mm256_cmpgt_epi16(_mm256_set1_epi16(j), vFirst);
+            __m256i s = _mm256_loadu_si256((const __m256i *)(rows[j - 1] + k));
+            h = _mm256_and_si256(_mm256_max_epi16(_mm256_adds_epi16(h, s), vZero), valid);
+        }
+        _mm256_storeu_si256((__m256i *)out, h);
+        std::copy(out, out + std::min(16, n1 - k), last + k);
+    }
+    for (; k + 64 <= n1; k += 64) {
+        __m256i h0 = vZero, h1 = vZero, h2 = vZero, h3 = vZero;
+        for (int j = 1; j <= n2; ++j) {
+            const int16_t *s = rows[j - 1] + k;
+            h0 = _mm256_max_epi16(_mm256_adds_epi16(h0, _mm256_loadu_si256((const __m256i *)s)), vZero);
+            h1 = _mm256_max_epi16(_mm256_adds_epi16(h1, _mm256_loadu_si256((const __m256i *)(s + 16))), vZero);
+            h2 = _mm256_max_epi16(_mm256_adds_epi16(h2, _mm256_loadu_si256((const __m256i *)(s + 32))), vZero);
+            h3 = _mm256_max_epi16(_mm256_adds_epi16(h3, _mm256_loadu_si256((const __m256i *)(s + 48))), vZero);
+        }
+        _mm256_storeu_si256((__m256i *)out, h0);
+        _mm256_storeu_si256((__m256i *)(out + 16), h1);
+        _mm256_storeu_si256((__m256i *)(out + 32), h2);
+        _mm256_storeu_si256((__m256i *)(out + 48), h3);
+        std::copy(out, out + 64, last + k);
+    }
+    for (; k < n1; k += 16) {
+        __m256i h = vZero;
+        for (int j = 1; j <= n2; ++j)
+            h = _mm256_max_epi16(_mm256_adds_epi16(h, _mm256_loadu_si256((const __m256i *)(rows[j - 1] + k))), vZero);
+        _mm256_storeu_si256((__m256i *)out, h);
+        std::copy(out, out + std::min(16, n1 - k), last + k);
+    }
+}
+
+#endif
+
+std::vector<SequenceOverlap> Overlapper::computeOverlapMany(const OverlapProfile& profile, const std::vector<OverlapPair>& reads, int minOverlap, double minIdentity, std::vector<bool>& found, AlignmentWorkspace& workspace)
+{
+    std::vector<SequenceOverlap> overlaps(reads.size());
+    found.assign(reads.size(), false);
+    const OverlapperParams& params = profile.getParams();
+    const OverlapperSIMD::Level level = OverlapperSIMD::level();
+
+    for (size_t p = 0; p < reads.size(); ++p) {
+        const OverlapPair& pair = reads[p];
+        const long long lo = pair.s1 - profile.sequence();
+        if (pair.n1 <= 0 || pair.n2 <= 0 || pair.n2 > profile.getMaxReadLength() || lo < 0
+                || lo + pair.n1 > profile.length() || !isUngapped(pair.n1, pair.n2, params)) {
+            found[p] = Overlapper::findOverlapUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, overlaps[p], workspace);
+            continue;
+        }
+
+        // Row j of diagonal k compares s2[j - 1] with s1[k + j - n2]
+        const int16_t **rows = workspace.buffer<const int16_t *>(4, pair.n2);
+        for (int j = 1; j <= pair.n2; ++j)
+            rows[j - 1] = profile.row(pair.s2[j - 1]) + profile.getMaxReadLength() + lo + j - pair.n2;
+
+        std::vector<int>& last_row = workspace.lastRow;
+        last_row.assign(pair.n1 + 1, 0);
+#ifdef OVERLAPPER_X86
+        if (level == OverlapperSIMD::AVX2)
+            scanProfileAVX2(rows, pair.n1, pair.n2, last_row.data() + 1);
+        else if (level == OverlapperSIMD::SSE41)
+            scanProfileSSE41(rows, pair.n1, pair.n2, last_row.data() + 1);
+        else
+#endif
+            scanProfileScalar(rows, pair.n1, pair.n2, last_row.data() + 1);
+
+        found[p] = backtrackUngapped(pair.s1, pair.n1, pair.s2, pair.n2, minOverlap, minIdentity, params, workspace, overlaps[p]);
+    }
+    return overlaps;
+}
@@ -0,0 +1,279 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_wfa - computeOverlapSW2 by wavefront alignment
+//
+// The overlaps of computeOverlapSW2 end in the last row, so with both
+// sequences reversed they start in the first row, at any column, and end
+// anywhere. Row by row, an alignment then scores match_score for every base
+// of s2 it covers less a penalty for each difference:
+//
+//   mismatch           match_score - mismatch_penalty
+//   gap in s1 (I)      match_score - gap_penalty
+//   gap in s2 (D)      -gap_penalty
+//
+// so that its score is match_score * j - s after j bases of s2 at penalty s.
+// The wavefront of penalty s holds, for each diagonal k = i - j, the furthest
+// j an alignment of penalty s reaches on it, which is the best score of the
+// diagonal at that penalty. Wavefronts are computed in order of penalty from
+// the three wavefronts a difference away, each cell extended along its run
+// of matches, until no alignment with more differences than a qualified
+// overlap allows is left, or no higher penalty can beat the best score.
+//
+// Each cell also keeps the column its alignment started in, so that equal
+// scores go to the leftmost endpoint like in computeOverlapSW2.
+//
+// When the wavefronts run to the last penalty a qualified overlap allows and
+// no cell is far enough into s2 for its penalty to allow one, there is none,
+// and no overlap is found without running the DP.
+//
+// ------------------------------------------------------------------------------
+#include "overlapper.h"
+#include "../error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The penalties of the differences, all positive
+struct WavefrontPenalties
+{
+    int mismatch;
+    int insertion;
+    int deletion;
+};
+
+// The best cell found so far
+struct WavefrontBest
+{
+    int score;
+    int penalty;
+    int k;
+    int j;
+    int origin;
+};
+
+// True if an overlap ending j bases into s2 at penalty s could qualify. It
+// has at least s / max_penalty differences and at most j plus as many columns
+static bool mayQualify(int s, int j, int max_penalty, int minOverlap, double minIdentity)
+{
+    int differences = (s + max_penalty - 1) / max_penalty;
+    int columns = j + differences;
+    return columns >= minOverlap && columns * (1.0 - minIdentity) + 1e-6 >= differences;
+}
+
+// The length of the run of matches of a from i and b from j
+static inline int extendMatches(const char *a, int n1, const char *b, int n2, int i, int j)
+{
+    int limit = std::min(n1 - i, n2 - j);
+    int length = 0;
+    while (length + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + i + length, sizeof(x));
+        memcpy(&y, b + j + length, sizeof(y));
+        if (x != y)
+            return length + __builtin_ctzll(x ^ y) / 8;
+        length += 8;
+    }
+    while (length < limit && a[i + length] == b[j + length])
+        length++;
+    return length;
+}
+
+// A cell packs the offset of a diagonal above the column its alignment
+// started in, so that the furthest cell, and of equally far cells the one
+// that started further right, is the largest. Cells no alignment reaches are
+// negative
+static const int64_t WAVEFRONT_NONE = -((int64_t)1 << 62);
+static const int64_t WAVEFRONT_STEP = (int64_t)1 << 32;
+
+static inline int64_t makeCell(int offset, int origin) { return (int64_t)offset << 32 | origin; }
+static inline int cellOffset(int64_t cell) { return (int)(cell >> 32); }
+static inline int cellOrigin(int64_t cell) { return (int)(cell & 0xffffffff); }
+
+// The cells of the wavefront of penalty s, indexed by diagonal from -n2 - 1
+// to n1 + 1. The first row of cells is left empty for penalties no
+// alignment has
+static inline const int64_t *wavefrontRow(const std::vector<WavefrontBounds>& wavefronts, const std::vector<int64_t>& cells,
+                                          int s, int n2)
+{
+    if (s < 0 || wavefronts[s].lo > wavefronts[s].hi)
+        return &cells[n2 + 1];
+    return &cells[wavefronts[s].base + n2 + 1];
+}
+
+// The furthest cell of diagonal k before its run of matches, from the
+// wavefronts a mismatch, a deletion and an insertion away, and which of the
+// three leads to it ('X', 'D' or 'I')
+static inline int64_t wavefrontPredecessor(const int64_t *mismatches, const int64_t *deletions, const int64_t *insertions,
+                                           int n1, int n2, int k, char& move)
+{
+    int64_t x = mismatches[k] + WAVEFRONT_STEP;
+    if (cellOffset(x) > n2 || k + cellOffset(x) > n1) x = WAVEFRONT_NONE;
+    int64_t d = deletions[k - 1];
+    if (k + cellOffset(d) > n1) d = WAVEFRONT_NONE;
+    int64_t i = insertions[k + 1] + WAVEFRONT_STEP;
+    if (cellOffset(i) > n2) i = WAVEFRONT_NONE;
+
+    int64_t cell = x;
+    move = 'X';
+    if (d > cell) { cell = d; move = 'D'; }
+    if (i > cell) { cell = i; move = 'I'; }
+    return cell;
+}
+
+SequenceOverlap Overlapper::computeOverlapWFA(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams params, AlignmentWorkspace& workspace)
+{
+    SequenceOverlap output;
+    if (!findOverlapWFA(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace))
+        error("No overlap was found.");
+    return output;
+}
+
+bool Overlapper::findOverlapWFA(const char* s1, int n1, const char* s2, int n2, int minOverlap, double minIdentity, const OverlapperParams& params, SequenceOverlap& output, AlignmentWorkspace& workspace)
+{
+    if(n1 == 0 || n2 == 0) {
+        std::cerr << "Overlapper::computeOverlapSW error: empty input sequence\n";
+        exit(EXIT_FAILURE);
+    }
+
+    const int match = params.match_score;
+    const WavefrontPenalties p = { match - params.mismatch_penalty, match - params.gap_penalty, -params.gap_penalty };
+    if (match <= 0 || p.mismatch <= 0 || p.insertion <= 0 || p.deletion <= 0 || minIdentity <= 0)
+        return findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace);
+
+    // A qualified overlap has at most max_differences differences, as it has
+    // at most n2 + max_differences columns. A difference that costs more than
+    // any overlap can score, like a gap with ungapped_params, is never taken
+    const int max_differences = (int)((1.0 - minIdentity) * n2 / minIdentity);
+    int max_penalty = 1;
+    const int penalties[3] = { p.mismatch, p.insertion, p.deletion };
+    for (int t = 0; t < 3; ++t)
+        if (penalties[t] < match * n2)
+            max_penalty = std::max(max_penalty, penalties[t]);
+    const long long budget = (long long)max_differences * max_penalty;
+
+    char *a = workspace.buffer<char>(0, n1);
+    char *b = workspace.buffer<char>(1, n2);
+    std::reverse_copy(s1, s1 + n1, a);
+    std::reverse_copy(s2, s2 + n2, b);
+
+    std::vector<WavefrontBounds>& wavefronts = workspace.wavefronts;
+    std::vector<int64_t>& cells = workspace.wavefrontCells;
+    const int width = n1 + n2 + 3;
+    wavefronts.clear();
+    cells.assign(width, WAVEFRONT_NONE);
+
+    // Alignments start on the diagonals of the first row
+    WavefrontBest best = { 0, 0, 0, 0, -1 };
+    wavefronts.push_back(WavefrontBounds{ 0, n1 - 1, cells.size() });
+    cells.resize(cells.size() + width, WAVEFRONT_NONE);
+    int64_t *row = &cells[wavefronts[0].base + n2 + 1];
+    int furthest = 0;
+    for (int k = 0; k < n1; ++k) {
+        int j = extendMatches(a, n1, b, n2, k, 0);
+        row[k] = makeCell(j, k);
+        furthest = std::max(furthest, j);
+        if (match * j > best.score || (match * j == best.score && best.origin >= 0))
+            best = WavefrontBest{ match * j, 0, k, j, k };
+    }
+    bool qualifiable = mayQualify(0, furthest, max_penalty, minOverlap, minIdentity);
+
+    int s = 1;
+    for (; s <= budget && (long long)match * n2 - s >= best.score; ++s) {
+        // The diagonals a difference can reach
+        int lo = n1, hi = -n2;
+        const int sources[3] = { s - p.mismatch, s - p.deletion, s - p.insertion };
+        const int shifts[3] = { 0, 1, -1 };
+        for (int t = 0; t < 3; ++t) {
+            if (sources[t] < 0 || wavefronts[sources[t]].lo > wavefronts[sources[t]].hi) continue;
+            lo = std::min(lo, wavefronts[sources[t]].lo + shifts[t]);
+            hi = std::max(hi, wavefronts[sources[t]].hi + shifts[t]);
+        }
+        lo = std::max(lo, -n2);
+        hi = std::min(hi, n1);
+        wavefronts.push_back(WavefrontBounds{ lo, hi, cells.size() });
+        if (lo > hi) continue;
+
+        cells.resize(cells.size() + width, WAVEFRONT_NONE);
+        row = &cells[wavefronts[s].base + n2 + 1];
+        const int64_t *mismatches = wavefrontRow(wavefronts, cells, s - p.mismatch, n2);
+        const int64_t *deletions = wavefrontRow(wavefronts, cells, s - p.deletion, n2);
+        const int64_t *insertions = wavefrontRow(wavefronts, cells, s - p.insertion, n2);
+        furthest = -1;
+        for (int k = lo; k <= hi; ++k) {
+            char move;
+            int64_t cell = wavefrontPredecessor(mismatches, deletions, insertions, n1, n2, k, move);
+            if (cell < 0) continue;
+            int offset = cellOffset(cell), origin = cellOrigin(cell);
+            offset += extendMatches(a, n1, b, n2, k + offset, offset);
+            row[k] = makeCell(offset, origin);
+            furthest = std::max(furthest, offset);
+            int score = match * offset - s;
+            if (score > best.score || (score == best.score && best.origin >= 0 && origin > best.origin))
+                best = WavefrontBest{ score, s, k, offset, origin };
+        }
+        qualifiable = qualifiable || (furthest >= 0 && mayQualify(s, furthest, max_penalty, minOverlap, minIdentity));
+    }
+
+    // Only a search that used up the budget rules every overlap out; one
+    // stopped by the best score may have left a qualified one unseen
+    if (!qualifiable && s > budget)
+        return false;
+    if (!qualifiable || best.origin < 0)
+        return findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace);
+
+    // Walk back from the best cell to its origin. This visits the overlap from
+    // its start in s1 and s2 on
+    output = SequenceOverlap();
+    output.score = best.score;
+    output.length[0] = n1;
+    output.length[1] = n2;
+    output.match[0].start = n1 - (best.k + best.j);
+    output.match[0].end = n1 - 1 - best.origin;
+    output.match[1].start = n2 - best.j;
+    output.match[1].end = n2 - 1;
+    output.edit_distance = 0;
+
+    std::string& cigar = workspace.cigar;
+    cigar.clear();
+    s = best.penalty;
+    int k = best.k, j = best.j;
+    while (true) {
+        int offset = 0;
+        char move = 0;
+        if (s > 0) {
+            offset = cellOffset(wavefrontPredecessor(wavefrontRow(wavefronts, cells, s - p.mismatch, n2),
+                                                     wavefrontRow(wavefronts, cells, s - p.deletion, n2),
+                                                     wavefrontRow(wavefronts, cells, s - p.insertion, n2),
+                                                     n1, n2, k, move));
+        }
+        cigar.append(j - offset, 'M');
+        if (s == 0)
+            break;
+        output.edit_distance += 1;
+        if (move == 'X') {
+            cigar.push_back('M');
+            s -= p.mismatch;
+            j = offset - 1;
+        } else if (move == 'D') {
+            cigar.push_back('D');
+            s -= p.deletion;
+            k -= 1;
+            j = offset;
+        } else {
+            cigar.push_back('I');
+            s -= p.insertion;
+            k += 1;
+            j = offset - 1;
+        }
+    }
+    output.total_columns = cigar.size();
+    output.cigar = compactCigar(cigar);
+
+    if (output.isQualified(minOverlap, minIdentity))
+        return true;
+    return findOverlapSW2(s1, n1, s2, n2, minOverlap, minIdentity, params, output, workspace);
+}
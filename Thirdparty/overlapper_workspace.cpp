@@ -0,0 +1,67 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_workspace - Reusable memory for the Overlapper functions
+//
+// ------------------------------------------------------------------------------
+#include "overlapper_workspace.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static const std::size_t BUFFER_ALIGNMENT = 64;
+
+static std::atomic<std::size_t> totalAllocations(0);
+
+void TracebackMatrix::resize(int n1, int n2)
+{
+    this->n1 = n1;
+    this->n2 = n2;
+    offset.resize(n1 + n2 + 2);
+    offset[0] = offset[1] = offset[2] = 0;
+    for (int k = 2; k <= n1 + n2; ++k)
+        offset[k + 1] = offset[k] + (last(k) - first(k) + 16) / 16;
+    // Every cell is written by the fill
+    words.resize(offset[n1 + n2 + 1]);
+}
+
+AlignmentWorkspace::AlignmentWorkspace() : numAllocations(0)
+{
+}
+
+AlignmentWorkspace::~AlignmentWorkspace()
+{
+    for (auto& b: buffers) free(b.data);
+}
+
+void *AlignmentWorkspace::reserve(int slot, std::size_t bytes)
+{
+    if ((std::size_t)slot >= buffers.size())
+        buffers.resize(slot + 1, Buffer{NULL, 0});
+    Buffer& b = buffers[slot];
+    if (bytes <= b.bytes) return b.data;
+
+    // Grow geometrically, so that slowly growing inputs settle quickly
+    std::size_t size = std::max(bytes, 2 * b.bytes);
+    size = (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+    void *data = NULL;
+    if (posix_memalign(&data, BUFFER_ALIGNMENT, size) != 0)
+        throw std::bad_alloc();
+    free(b.data);
+    b.data = data;
+    b.bytes = size;
+    numAllocations++;
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    return data;
+}
+
+AlignmentWorkspace& AlignmentWorkspace::local()
+{
+    static thread_local AlignmentWorkspace workspace;
+    return workspace;
+}
+
+std::size_t AlignmentWorkspace::getTotalAllocations()
+{
+    return totalAllocations.load();
+}
@@ -0,0 +1,135 @@
+//-------------------------------------------------------------------------------
+//
+// overlapper_workspace - Reusable memory for the Overlapper functions
+//
+// ------------------------------------------------------------------------------
+#ifndef OVERLAPPER_WORKSPACE_H
+#define OVERLAPPER_WORKSPACE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The traceback of the computeOverlapSW2 matrix of s1 (columns i) and s2
+// (rows j): for every inner cell, the move the backtrack takes from it, in
+// 2 bits. The cells are stored by anti-diagonals k = i + j, 16 to a word, so
+// that the fill can write the directions of a vector of cells at once.
+class TracebackMatrix
+{
+public:
+    // STOP marks a cell with score 0, where the local alignment starts
+    enum Direction { STOP = 0, UP = 1, LEFT = 2, DIAGONAL = 3 };
+
+    TracebackMatrix() : n1(0), n2(0) {}
+
+    void resize(int n1, int n2);
+
+    // The inner cells of diagonal k
+    int first(int k) const { return std::max(1, k - n2); }
+    int last(int k) const { return std::min(n1, k - 1); }
+
+    // The words of diagonal k, starting at i = first(k)
+    uint32_t *diagonal(int k) { return &words[offset[k]]; }
+
+    Direction operator()(int i, int j) const
+    {
+        int p = i - first(i + j);
+        return (Direction)((words[offset[i + j] + p / 16] >> (2 * (p % 16))) & 3);
+    }
+
+    std::size_t bytes() const { return words.size() * sizeof(uint32_t); }
+
+private:
+    int n1;
+    int n2;
+    std::vector<uint32_t> words;
+    std::vector<std::size_t> offset;
+};
+
+// A dynamic programming matrix laid out in one block: m[i][j] is element j
+// of line i
+template<class T>
+class DPView
+{
+public:
+    DPView(T *data, std::size_t columns) : data(data), columns(columns) {}
+    T *operator[](std::size_t i) const { return data + i * columns; }
+
+private:
+    T *data;
+    std::size_t columns;
+};
+
+// The diagonals lo..hi of the wavefront of one penalty in computeOverlapWFA.
+// Its cells are stored from base on, one for each diagonal of the matrix;
+// lo > hi if no alignment has that penalty
+struct WavefrontBounds
+{
+    int lo;
+    int hi;
+    std::size_t base;
+};
+
+// The buffers an alignment needs, kept from one alignment to the next so
+// that the steady state allocates nothing. Buffers are 64-byte aligned and
+// only ever grow. Each Overlapper function takes a workspace, by default the
+// one of the calling thread; a workspace must not be shared by threads.
+// A function numbers the buffers it uses from 0 and must not call another
+// Overlapper function while it still needs their contents.
+class AlignmentWorkspace
+{
+public:
+    AlignmentWorkspace();
+    virtual ~AlignmentWorkspace();
+
+    // At least n elements in buffer slot, with undefined contents
+    template<class T>
+    T *buffer(int slot, std::size_t n) { return (T *)reserve(slot, n * sizeof(T)); }
+
+    // A lines x columns matrix in buffer slot with every element set to value
+    template<class T>
+    DPView<T> matrix(int slot, std::size_t lines, std::size_t columns, const T& value = T())
+    {
+        T *data = buffer<T>(slot, lines * columns);
+        std::fill(data, data + lines * columns, value);
+        return DPView<T>(data, columns);
+    }
+
+    // Working state of computeOverlapSW2 and computeOverlapUngapped
+    TracebackMatrix traceback;
+    std::vector<int> lastRow;
+    std::vector<std::size_t> endpoints;
+    // Working state of computeOverlapWFA: the wavefronts by penalty, and
+    // their cells, each an offset and an origin packed in 64 bits
+    std::vector<WavefrontBounds> wavefronts;
+    std::vector<int64_t> wavefrontCells;
+    // The expanded cigar string of a backtrack
+    std::string cigar;
+
+    // The number of times a buffer of this workspace had to grow
+    std::size_t getNumAllocations() const { return numAllocations; }
+
+    // The workspace of the calling thread
+    static AlignmentWorkspace& local();
+    // The number of buffer allocations of all workspaces so far
+    static std::size_t getTotalAllocations();
+
+private:
+    AlignmentWorkspace(const AlignmentWorkspace&);
+    AlignmentWorkspace& operator=(const AlignmentWorkspace&);
+
+    void *reserve(int slot, std::size_t bytes);
+
+    struct Buffer
+    {
+        void *data;
+        std::size_t bytes;
+    };
+
+    std::vector<Buffer> buffers;
+    std::size_t numAllocations;
+};
+
+#endif
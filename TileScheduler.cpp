@@ -0,0 +1,101 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+
+using namespace std;
+
+TileScheduler::TileScheduler(const vector<double> &costs, int numThreads, bool bInOrder)
+    : costs(costs), bInOrder(bInOrder), stats(numThreads)
+{
+    for (int i = 0; i < numThreads; ++i) {
+        queues.push_back(new WorkQueue);
+        queues.back()->remainingCost = 0;
+        stats[i] = {0, 0, 0};
+    }
+
+    vector<size_t> order(costs.size());
+    iota(order.begin(), order.end(), 0);
+    if (bInOrder) {
+        // One queue shared by all threads
+        for (auto i: order) {
+            queues[0]->tiles.push_back(i);
+            queues[0]->remainingCost += costs[i];
+        }
+        return;
+    }
+
+    // Stable, so tiles of equal cost keep their genomic order
+    stable_sort(order.begin(), order.end(), [&costs](size_t i1, size_t i2) { return costs[i1] > costs[i2]; });
+
+    for (size_t k = 0; k < order.size(); ++k) {
+        WorkQueue *pQueue = queues[k % numThreads];
+        pQueue->tiles.push_back(order[k]);
+        pQueue->remainingCost += costs[order[k]];
+    }
+}
+
+TileScheduler::~TileScheduler()
+{
+    for (auto pQueue: queues) delete pQueue;
+}
+
+bool TileScheduler::next(int threadId, size_t &index)
+{
+    WorkQueue *pQueue = queues[bInOrder ? 0 : threadId];
+    {
+        lock_guard<mutex> lock(pQueue->mtx);
+        if (!pQueue->tiles.empty()) {
+            index = pQueue->tiles.front();
+            pQueue->tiles.pop_front();
+            pQueue->remainingCost -= costs[index];
+            stats[threadId].numTiles++;
+            return true;
+        }
+    }
+    return !bInOrder && steal(threadId, index);
+}
+
+bool TileScheduler::steal(int threadId, size_t &index)
+{
+    while (true) {
+        // Pick the victim with the most work left; the estimate may be stale
+        // by the time we lock it, in which case we simply look again.
+        int victim = -1;
+        double maxCost = -1;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            if ((int)i == threadId) continue;
+            lock_guard<mutex> lock(queues[i]->mtx);
+            if (!queues[i]->tiles.empty() && queues[i]->remainingCost > maxCost) {
+                maxCost = queues[i]->remainingCost;
+                victim = i;
+            }
+        }
+        if (victim == -1) return false;
+
+        WorkQueue *pQueue = queues[victim];
+        lock_guard<mutex> lock(pQueue->mtx);
+        if (pQueue->tiles.empty()) continue;
+        index = pQueue->tiles.back();
+        pQueue->tiles.pop_back();
+        pQueue->remainingCost -= costs[index];
+        stats[threadId].numTiles++;
+        stats[threadId].numStolen++;
+        return true;
+    }
+}
+
+void TileScheduler::addBusyTime(int threadId, double seconds)
+{
+    stats[threadId].busyTime += seconds;
+}
+
+void TileScheduler::printStats(double wallTime) const
+{
+    for (size_t i = 0; i < stats.size(); ++i) {
+        fprintf(stderr, "[scheduler - thread %zu] busy: %.2lfs idle: %.2lfs tiles: %zu stolen: %zu\n",
+                i, stats[i].busyTime, max(0.0, wallTime - stats[i].busyTime),
+                stats[i].numTiles, stats[i].numStolen);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Work-stealing scheduler over a fixed set of tiles. The tiles are sorted by
+// their estimated cost and dealt round-robin to one deque per thread, so every
+// thread starts on the most expensive tiles it has. A thread takes work from
+// the front of its own deque and, once that is empty, steals from the back of
+// the deque with the most remaining cost.
+// In order, the tiles are instead kept in one queue in their given order and
+// every thread takes the next one, so the tiles being called at any time are
+// close together in the genome.
+class TileScheduler
+{
+public:
+    TileScheduler(const std::vector<double>& costs, int numThreads, bool bInOrder = false);
+    virtual ~TileScheduler();
+
+    // Get the next tile for the thread; returns false when no work is left
+    bool next(int threadId, std::size_t& index);
+
+    // Account the time the thread spent on its last tile
+    void addBusyTime(int threadId, double seconds);
+
+    // Print the busy and idle time of every thread over a run of the given length
+    void printStats(double wallTime) const;
+
+private:
+    struct WorkQueue
+    {
+        std::deque<std::size_t> tiles;
+        double remainingCost;
+        std::mutex mtx;
+    };
+
+    struct ThreadStats
+    {
+        double busyTime;
+        std::size_t numTiles;
+        std::size_t numStolen;
+    };
+
+    bool steal(int threadId, std::size_t& index);
+
+    std::vector<double> costs;
+    bool bInOrder;
+    std::vector<WorkQueue*> queues;
+    std::vector<ThreadStats> stats;
+};
+
+#endif // TILESCHEDULER_H
@@ -0,0 +1,251 @@
+// bench_overlapper - Throughput of the overlap kernels
+//
+// Aligns reads of 100-150 bp to target regions of 300-800 bp, the sizes of
+// the clips and the regions they are aligned to, and prints the cells of
+// the matrix filled per second by the scalar, SSE4.1 and AVX2 kernels. Half
+// of the reads overlap their target with a few differences, the others are
+// random, as most target regions hold no overlap. It then times
+// findOverlapWFA and findOverlapUngapped against findOverlapSW2 and counts
+// where their overlaps differ.
+//
+// With --check it instead compares WFA with SW2 on small random pairs and
+// fails if WFA misses an overlap that SW2 finds.
+//
+//   bench_overlapper [rounds]
+//   bench_overlapper --check
+
+#include "Thirdparty/overlapper.h"
+#include "Thirdparty/overlapper_simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const int MIN_OVERLAP = 12;
+static const double MIN_IDENTITY = 0.96;
+static const int READ_LENGTHS[] = { 100, 125, 150 };
+static const int TARGET_LENGTHS[] = { 300, 550, 800 };
+static const int PAIRS_PER_SHAPE = 200;
+static const int CHECK_PAIRS = 40000;
+
+struct Pair
+{
+    string target;
+    string read;
+};
+
+static string randomBases(mt19937 &rng, int n)
+{
+    string s(n, 'A');
+    for (auto &c: s) c = "ACGT"[rng() % 4];
+    return s;
+}
+
+// A copy of s with about one difference in 25 bases
+static string mutate(mt19937 &rng, const string &s)
+{
+    string t;
+    for (char c: s) {
+        switch (rng() % 75) {
+        case 0: t.push_back("ACGT"[rng() % 4]); break;
+        case 1: break;
+        case 2: t.push_back(c); t.push_back("ACGT"[rng() % 4]); break;
+        default: t.push_back(c);
+        }
+    }
+    return t;
+}
+
+// Pairs at even indices overlap, the others are random
+static vector<Pair> makePairs(mt19937 &rng, int readLength, int targetLength, int count = PAIRS_PER_SHAPE)
+{
+    vector<Pair> pairs;
+    for (int p = 0; p < count; ++p) {
+        Pair pair = { randomBases(rng, targetLength), randomBases(rng, readLength) };
+        if (p % 2 == 0) {
+            // The clipped end of the read lies somewhere in the target
+            int clipped = 20 + rng() % (readLength - 20);
+            string part = mutate(rng, pair.read.substr(readLength - clipped));
+            if ((int)part.size() < targetLength)
+                pair.target.replace(rng() % (targetLength - part.size()), part.size(), part);
+        }
+        pairs.push_back(pair);
+    }
+    return pairs;
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+typedef bool (*FindOverlap)(const char *, int, const char *, int, int, double, const OverlapperParams &,
+                            SequenceOverlap &, AlignmentWorkspace &);
+
+struct KernelRun
+{
+    double micros;
+    vector<bool> found;
+    vector<SequenceOverlap> overlaps;
+};
+
+static KernelRun runKernel(FindOverlap find, const vector<Pair> &pairs, const OverlapperParams &params, int rounds)
+{
+    KernelRun run;
+    run.found.resize(pairs.size());
+    run.overlaps.resize(pairs.size());
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t p = 0; p < pairs.size(); ++p)
+            run.found[p] = find(pairs[p].target.data(), pairs[p].target.size(), pairs[p].read.data(),
+                                pairs[p].read.size(), MIN_OVERLAP, MIN_IDENTITY, params, run.overlaps[p],
+                                AlignmentWorkspace::local());
+    }
+    run.micros = secondsSince(start) * 1e6 / ((double)rounds * pairs.size());
+    return run;
+}
+
+// Prints the time per pair of a kernel and how its overlaps differ from SW2's
+static void printComparison(const char *name, const char *paramsName, const char *pairsName, const KernelRun &run,
+                            const KernelRun &sw2)
+{
+    int found = 0, sw2Only = 0, kernelOnly = 0, scoreDiff = 0;
+    for (size_t p = 0; p < run.found.size(); ++p) {
+        found += run.found[p];
+        if (sw2.found[p] && !run.found[p]) ++sw2Only;
+        if (!sw2.found[p] && run.found[p]) ++kernelOnly;
+        if (sw2.found[p] && run.found[p] && sw2.overlaps[p].score != run.overlaps[p].score) ++scoreDiff;
+    }
+    printf("%-9s %-8s %-10s %10.1f %7d %9d %12d %11d\n", name, paramsName, pairsName, run.micros, found, sw2Only,
+           kernelOnly, scoreDiff);
+}
+
+static void compareKernels(int rounds)
+{
+    // 100 bp reads, half with a 20-99 bp clip in their 500 bp target
+    mt19937 rng(17);
+    vector<Pair> pairs = makePairs(rng, 100, 500, 2000);
+    vector<Pair> related, unrelated;
+    for (size_t p = 0; p < pairs.size(); ++p) (p % 2 == 0 ? related : unrelated).push_back(pairs[p]);
+
+    printf("\n%-9s %-8s %-10s %10s %7s %9s %12s %11s\n", "kernel", "params", "pairs", "us/pair", "found", "sw2-only",
+           "kernel-only", "score-diff");
+    const OverlapperParams *params[] = { &default_params, &ungapped_params };
+    const char *paramsNames[] = { "default", "ungapped" };
+    const vector<Pair> *sets[] = { &related, &unrelated };
+    const char *setNames[] = { "related", "unrelated" };
+    for (int q = 0; q < 2; ++q) {
+        for (int t = 0; t < 2; ++t) {
+            KernelRun sw2 = runKernel(Overlapper::findOverlapSW2, *sets[t], *params[q], rounds);
+            printComparison("sw2", paramsNames[q], setNames[t], sw2, sw2);
+            printComparison("wfa", paramsNames[q], setNames[t],
+                            runKernel(Overlapper::findOverlapWFA, *sets[t], *params[q], rounds), sw2);
+            if (params[q] == &ungapped_params)
+                printComparison("ungapped", paramsNames[q], setNames[t],
+                                runKernel(Overlapper::findOverlapUngapped, *sets[t], *params[q], rounds), sw2);
+        }
+    }
+}
+
+// WFA must find an overlap wherever SW2 finds one. Returns the number of
+// pairs where it does not
+static int checkWFA()
+{
+    const OverlapperParams params[] = { default_params, ungapped_params };
+    int sw2Only = 0, wfaOnly = 0, scoreDiff = 0;
+    mt19937 rng(7);
+    for (int t = 0; t < CHECK_PAIRS; ++t) {
+        int n1 = 5 + rng() % 60, n2 = 5 + rng() % 30;
+        string s1 = randomBases(rng, n1), s2 = randomBases(rng, n2);
+        if (rng() % 2) {
+            // Copy the end of s2, with a few differences, to either end of s1
+            int length = min(n1, n2) * (3 + rng() % 5) / 8;
+            for (int q = 0; q < length; ++q) {
+                char c = s2[n2 - length + q];
+                if (rng() % 12 == 0) c = "ACGT"[rng() % 4];
+                s1[rng() % 2 ? q : n1 - length + q] = c;
+            }
+        }
+        int minOverlap = 3 + rng() % 15;
+        double minIdentity = 0.6 + 0.4 * (rng() % 100) / 100.0;
+        SequenceOverlap sw2, wfa;
+        bool foundSW2 = Overlapper::findOverlapSW2(s1.data(), n1, s2.data(), n2, minOverlap, minIdentity, params[t % 2], sw2);
+        bool foundWFA = Overlapper::findOverlapWFA(s1.data(), n1, s2.data(), n2, minOverlap, minIdentity, params[t % 2], wfa);
+        if (foundSW2 && !foundWFA) {
+            if (sw2Only < 5)
+                fprintf(stderr, "[bench] WFA misses %s %s minOverlap %d minIdentity %.2f\n", s1.c_str(), s2.c_str(),
+                        minOverlap, minIdentity);
+            ++sw2Only;
+        }
+        if (!foundSW2 && foundWFA) ++wfaOnly;
+        if (foundSW2 && foundWFA && sw2.score != wfa.score) ++scoreDiff;
+    }
+    printf("[bench] pairs: %d\n[bench] sw2-only: %d\n[bench] wfa-only: %d\n[bench] score-diff: %d\n", CHECK_PAIRS,
+           sw2Only, wfaOnly, scoreDiff);
+    return sw2Only;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) return checkWFA() == 0 ? 0 : 1;
+
+    int rounds = argc > 1 ? atoi(argv[1]) : 5;
+    if (rounds < 1) rounds = 1;
+
+    mt19937 rng(42);
+    vector<vector<Pair> > shapes;
+    for (int readLength: READ_LENGTHS)
+        for (int targetLength: TARGET_LENGTHS)
+            shapes.push_back(makePairs(rng, readLength, targetLength));
+
+    const OverlapperSIMD::Level levels[] = { OverlapperSIMD::SCALAR, OverlapperSIMD::SSE41, OverlapperSIMD::AVX2 };
+    printf("%-8s %-10s %12s %12s %8s\n", "level", "shape", "fill Mc/s", "sw2 Mc/s", "found");
+    for (auto level: levels) {
+        OverlapperSIMD::setMaxLevel(level);
+        // Not supported by the CPU
+        if (OverlapperSIMD::level() != level) continue;
+        const char *name = OverlapperSIMD::levelName(level);
+        for (auto &pairs: shapes) {
+            double cells = 0;
+            for (auto &pair: pairs) cells += (double)pair.target.size() * pair.read.size();
+            cells *= rounds;
+
+            // The whole matrix, as filled without a score bound
+            auto start = chrono::steady_clock::now();
+            for (int r = 0; r < rounds; ++r) {
+                for (auto &pair: pairs)
+                    OverlapperSIMD::fillSW2(pair.target.data(), pair.target.size(), pair.read.data(), pair.read.size(),
+                                            default_params, AlignmentWorkspace::local());
+            }
+            double fillSeconds = secondsSince(start);
+
+            // computeOverlapSW2 from the fill to the overlap, in cells of the
+            // whole matrix
+            int found = 0;
+            start = chrono::steady_clock::now();
+            for (int r = 0; r < rounds; ++r) {
+                for (auto &pair: pairs) {
+                    SequenceOverlap overlap;
+                    found += Overlapper::findOverlapSW2(pair.target.data(), pair.target.size(), pair.read.data(),
+                                                        pair.read.size(), MIN_OVERLAP, MIN_IDENTITY, default_params, overlap);
+                }
+            }
+            double sw2Seconds = secondsSince(start);
+
+            char shape[32];
+            snprintf(shape, sizeof(shape), "%zux%zu", pairs[0].read.size(), pairs[0].target.size());
+            printf("%-8s %-10s %12.1f %12.1f %8d\n", name, shape, cells / fillSeconds * 1e-6, cells / sw2Seconds * 1e-6,
+                   found / rounds);
+        }
+    }
+
+    compareKernels(rounds);
+    return 0;
+}
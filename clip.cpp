@@ -3,12 +3,48 @@
 #include "Helper.h"
 #include <iterator>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <sstream>
 #include <utility>
 
 using namespace std;
 using namespace BamTools;
 
+// Target regions aligned by computeOverlap over all threads, and the time
+// spent on them, to weigh the prefilter against the alignments it saves
+static atomic<size_t> numRegions(0);
+static atomic<size_t> numRejected(0);
+static atomic<size_t> numNotFound(0);
+static atomic<long long> prefilterNanos(0);
+static atomic<long long> notFoundNanos(0);
+static atomic<size_t> numSeeded(0);
+static atomic<size_t> numSeedRejected(0);
+static atomic<size_t> seededBases(0);
+static atomic<size_t> alignedBases(0);
+static atomic<size_t> numExactTried(0);
+static atomic<size_t> numExactFound(0);
+static atomic<size_t> numBatchedPairs(0);
+static atomic<size_t> numAlignmentBatches(0);
+static atomic<size_t> numProfiledPairs(0);
+static atomic<size_t> numProfiles(0);
+
+// Clips by outcome over all threads
+static atomic<size_t> numClips[NUM_CLIP_STATUSES];
+
+// True if s holds nothing but ACGT, so that the seeds of a qualified overlap
+// are all in a SeedIndex
+static bool isNucleotides(const string &s)
+{
+    return s.find_first_not_of("ACGTacgt") == string::npos;
+}
+
+static long long nanosSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
 AbstractClip::AbstractClip(int referenceId, int mapPosition, int clipPosition, int matePosition, const string &sequence, const vector<CigarOp>& cigar)
     : referenceId(referenceId),
       mapPosition(mapPosition),
@@ -16,7 +52,12 @@ AbstractClip::AbstractClip(int referenceId, int mapPosition, int clipPosition, i
       matePosition(matePosition),
       sequence(sequence),
       cigar(cigar),
-      conflictFlag(false) {
+      conflictFlag(false),
+      bPrefetched(false),
+      pSeedIndex(NULL),
+      bExactFirst(false),
+      pOverlapBatch(NULL),
+      pAligner(NULL) {
 }
 
 int AbstractClip::length() const {
@@ -31,21 +72,342 @@ int AbstractClip::leftmostPosition() const {
 AbstractClip::~AbstractClip() {
 }
 
-Deletion AbstractClip::call(BamReader &reader, FaidxWrapper &faidx, int insLength, int minOverlap, double minIdentity, int minMapQual)
+ClipStatus AbstractClip::call(PairSource &source, const string &refName, FaidxWrapper &faidx, AlignmentCache *pCache, int insLength, int minOverlap, double minIdentity, int minMapQual, vector<Deletion> &deletions)
 {
-    string refName = Helper::getReferenceName(reader, referenceId);
+    vector<TargetRegion> regions;
+    ClipStatus status = findTargetRegions(source, refName, insLength, minMapQual, regions);
+    if (status != CLIP_CALLED) return status;
+    return call(faidx, pCache, regions, minOverlap, minIdentity, deletions);
+}
 
+ClipStatus AbstractClip::findTargetRegions(PairSource &source, const string &refName, int insLength, int minMapQual, vector<TargetRegion> &regions)
+{
     vector<IRange> ranges;
-    fetchSpanningRanges(reader, insLength, ranges, minMapQual);
+    bool bValid;
+    if (bPrefetched) {
+        PrefetchedPairSource prefetched(spanningRecords);
+        bValid = fetchSpanningRanges(prefetched, insLength, ranges, minMapQual);
+    } else {
+        bValid = fetchSpanningRanges(source, insLength, ranges, minMapQual);
+    }
 //    vector<int> sizes;
 //    fecthSizesForSpanningPairs(reader, insLength, sizes);
 
-    if (ranges.empty()) error("No deletion is found");
+    if (!bValid) return CLIP_INVALID_REGION;
+    if (ranges.empty()) return CLIP_NO_SPANNING_PAIRS;
 
-    vector<TargetRegion> regions;
     toTargetRegions(refName, insLength, ranges, regions);
+    return regions.empty() ? CLIP_NO_TARGET_REGIONS : CLIP_CALLED;
+}
 
-    return call(faidx, regions, minOverlap, minIdentity);
+bool AbstractClip::spanningRegion(int insLength, int &start, int &end)
+{
+    return false;
+}
+
+void AbstractClip::setSpanningRecords(vector<PairRecord> &records)
+{
+    spanningRecords.swap(records);
+    bPrefetched = true;
+}
+
+// Every qualified overlap contains a seed, and spans at most n2 plus as many
+// bases as it may have differences. Narrow target, the (reversed) bases of
+// region, to the bases within that reach of the seeds of s2, lo being the
+// first one left; false if there are no seeds
+static bool narrowToSeeds(const SeedIndex &index, const TargetRegion &region, bool bReversed, const string &s2,
+                          double minIdentity, SequenceView &target, int &lo)
+{
+    static thread_local string read;
+    static thread_local vector<pair<int, int> > hits;
+    read.assign(s2);
+    if (bReversed) reverse(read.begin(), read.end());
+    hits.clear();
+    index.lookup(read.data(), read.size(), region.start, region.end, hits);
+    if (hits.empty()) return false;
+
+    int first = target.length, last = 0;
+    for (auto &hit: hits) {
+        int offset = hit.first - region.start;
+        int position = bReversed ? target.length - index.getK() - offset : offset;
+        first = min(first, position);
+        last = max(last, position + index.getK());
+    }
+    int reach = s2.size() + (int)((1.0 - minIdentity) * s2.size() / minIdentity) + 1;
+    lo = max(0, first - reach);
+    int hi = min(target.length, last + reach);
+    target.data += lo;
+    target.length = hi - lo;
+    return true;
+}
+
+// The bases of region, from the seed index if it has them, reversed if
+// bReversed. The view is valid until the next fetch
+static SequenceView fetchTarget(FaidxWrapper &faidx, const SeedIndex *pIndex, const TargetRegion &region, bool bReversed)
+{
+    SequenceView target;
+    if (pIndex != NULL && pIndex->covers(region.referenceName, region.start, region.end))
+        target = { pIndex->data(region.start), region.end - region.start + 1 };
+    else
+        target = faidx.fetchView(region.referenceName, region.start, region.end);
+    if (bReversed) {
+        static thread_local string reversed;
+        reversed.assign(target.data, target.length);
+        reverse(reversed.begin(), reversed.end());
+        target.data = reversed.data();
+    }
+    return target;
+}
+
+AlignmentKey AbstractClip::overlapKey(const TargetRegion &region, bool bReversed, const string &s2,
+                                     int minOverlap, double minIdentity) const
+{
+    bool bSeeded = pSeedIndex != NULL && pSeedIndex->covers(region.referenceName, region.start, region.end)
+                   && Overlapper::minSeedLength(s2.size(), minOverlap, minIdentity) >= pSeedIndex->getK()
+                   && isNucleotides(s2);
+    return { region.referenceName, region.start, region.end, bReversed, s2, minOverlap, minIdentity, ungapped_params,
+             bSeeded };
+}
+
+void AbstractClip::prepareOverlap(const SequenceView &bases, const TargetRegion &region, bool bReversed, const string &s2,
+                                  int minOverlap, double minIdentity, PendingOverlap &pending)
+{
+    SequenceView &target = pending.target;
+    target = bases;
+
+    pending.regionLength = target.length;
+    pending.lo = 0;
+    bool bHasSeeds = true;
+    if (pending.key.bSeeded) {
+        numSeeded++;
+        bHasSeeds = narrowToSeeds(*pSeedIndex, region, bReversed, s2, minIdentity, target, pending.lo);
+        if (bHasSeeds) {
+            seededBases += pending.regionLength;
+            alignedBases += target.length;
+        } else {
+            numSeedRejected++;
+        }
+    }
+
+    pending.result.bFound = false;
+    if (bHasSeeds && bExactFirst) {
+        numExactTried++;
+        pending.result.bFound = Overlapper::findOverlapExact(target.data, target.length, s2.data(), s2.size(),
+                                                             minOverlap, minIdentity, ungapped_params, pending.result.overlap);
+        if (pending.result.bFound) numExactFound++;
+    }
+
+    // Most regions hold no qualified overlap; the prefilter rules out many of
+    // them for a fraction of the cost of the alignment
+    pending.bAlign = false;
+    if (bHasSeeds && !pending.result.bFound) {
+        numRegions++;
+        auto start = chrono::steady_clock::now();
+        pending.bAlign = Overlapper::mayOverlap(target.data, target.length, s2.data(), s2.size(), minOverlap, minIdentity);
+        prefilterNanos += nanosSince(start);
+        if (!pending.bAlign) numRejected++;
+    }
+}
+
+// Back to the coordinates of the whole region, and into the cache
+static void finishOverlap(AlignmentCache *pCache, PendingOverlap &pending)
+{
+    if (pending.result.bFound) {
+        pending.result.overlap.match[0].start += pending.lo;
+        pending.result.overlap.match[0].end += pending.lo;
+        pending.result.overlap.length[0] = pending.regionLength;
+    }
+    if (pCache != NULL) pCache->insert(pending.key, pending.result);
+}
+
+bool AbstractClip::computeOverlap(FaidxWrapper &faidx, AlignmentCache *pCache, const TargetRegion &region, bool bReversed,
+                                  const string &s2, int minOverlap, double minIdentity, SequenceOverlap &overlap)
+{
+    PendingOverlap pending;
+    pending.key = overlapKey(region, bReversed, s2, minOverlap, minIdentity);
+    AlignmentResult &result = pending.result;
+    if ((pOverlapBatch != NULL && pOverlapBatch->find(pending.key, result))
+            || (pCache != NULL && pCache->find(pending.key, result))) {
+        overlap = result.overlap;
+        return result.bFound;
+    }
+
+    prepareOverlap(fetchTarget(faidx, pSeedIndex, region, bReversed), region, bReversed, s2, minOverlap, minIdentity, pending);
+    if (pending.bAlign) {
+        const SequenceView &target = pending.target;
+        Aligner &aligner = pAligner != NULL ? *pAligner : Aligner::defaultAligner();
+        auto start = chrono::steady_clock::now();
+        result.bFound = aligner.align(OverlapPair{ target.data, target.length, s2.data(), (int)s2.size() },
+                                      minOverlap, minIdentity, ungapped_params, result.overlap);
+        if (!result.bFound) {
+            numNotFound++;
+            notFoundNanos += nanosSince(start);
+        }
+    }
+    finishOverlap(pCache, pending);
+    overlap = result.overlap;
+    return result.bFound;
+}
+
+void AbstractClip::addOverlap(FaidxWrapper &faidx, AlignmentCache *pCache, const TargetRegion &region, bool bReversed,
+                              const string &s2, int minOverlap, double minIdentity, OverlapBatch &batch)
+{
+    PendingOverlap pending;
+    pending.key = overlapKey(region, bReversed, s2, minOverlap, minIdentity);
+    if (batch.contains(pending.key) || (pCache != NULL && pCache->find(pending.key, pending.result)))
+        return;
+    prepareOverlap(batch.target(faidx, pSeedIndex, region, bReversed), region, bReversed, s2, minOverlap, minIdentity, pending);
+    batch.add(pending);
+}
+
+SequenceView OverlapBatch::target(FaidxWrapper &faidx, const SeedIndex *pIndex, const TargetRegion &region, bool bReversed)
+{
+    TargetKey key(region.referenceName, region.start, region.end, bReversed);
+    auto it = targetIndex.find(key);
+    if (it == targetIndex.end()) {
+        SequenceView bases = fetchTarget(faidx, pIndex, region, bReversed);
+        it = targetIndex.insert(make_pair(key, targets.size())).first;
+        targets.push_back(string(bases.data, bases.length));
+    }
+    const string &bases = targets[it->second];
+    return { bases.data(), (int)bases.size() };
+}
+
+void OverlapBatch::add(const PendingOverlap &overlap)
+{
+    const AlignmentKey &key = overlap.key;
+    index[key] = pending.size();
+    pending.push_back(overlap);
+    targetOf.push_back(targetIndex[TargetKey(key.referenceName, key.start, key.end, key.bReversed)]);
+}
+
+bool OverlapBatch::find(const AlignmentKey &key, AlignmentResult &result) const
+{
+    auto it = index.find(key);
+    if (it == index.end()) return false;
+    result = pending[it->second].result;
+    return true;
+}
+
+void OverlapBatch::align(AlignmentCache *pCache, Aligner &aligner)
+{
+    // The overlaps to align by target
+    vector<vector<size_t> > byTarget(targets.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (pending[i].bAlign) byTarget[targetOf[i]].push_back(i);
+    }
+    vector<size_t> alone;
+    for (auto &overlaps: byTarget) {
+        if (overlaps.size() == 1) alone.push_back(overlaps[0]);
+    }
+    if ((int)alone.size() < aligner.batchWidth()) alone.clear();
+
+    auto start = chrono::steady_clock::now();
+    size_t numAligned = 0, notFound = 0;
+    vector<OverlapPair> pairs;
+    vector<SequenceOverlap> results;
+    vector<bool> found;
+    // Take the results of the pairs aligned for the overlaps
+    auto collect = [this, &results, &found, &notFound](const vector<size_t> &overlaps) {
+        for (size_t p = 0; p < overlaps.size(); ++p) {
+            pending[overlaps[p]].result.bFound = found[p];
+            pending[overlaps[p]].result.overlap = results[p];
+            if (!found[p]) notFound++;
+        }
+    };
+    auto toPairs = [this, &pairs](const vector<size_t> &overlaps) {
+        pairs.clear();
+        for (size_t i: overlaps) {
+            const string &read = pending[i].key.read;
+            pairs.push_back(OverlapPair{ pending[i].target.data, pending[i].target.length, read.data(), (int)read.size() });
+        }
+    };
+
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const vector<size_t> &overlaps = byTarget[t];
+        if (overlaps.empty() || (overlaps.size() == 1 && !alone.empty())) continue;
+        toPairs(overlaps);
+        const AlignmentKey &key = pending[overlaps[0]].key;
+        aligner.alignMany(targets[t].data(), targets[t].size(), pairs, key.minOverlap, key.minIdentity, ungapped_params,
+                          results, found);
+        collect(overlaps);
+        numAligned += pairs.size();
+        numProfiledPairs += pairs.size();
+        numProfiles++;
+    }
+    if (!alone.empty()) {
+        toPairs(alone);
+        const AlignmentKey &key = pending[alone[0]].key;
+        aligner.alignBatch(pairs, key.minOverlap, key.minIdentity, ungapped_params, results, found);
+        collect(alone);
+        numAligned += pairs.size();
+        numBatchedPairs += pairs.size();
+        numAlignmentBatches++;
+    }
+
+    if (numAligned > 0) {
+        // The time of the batch, shared out evenly
+        numNotFound += notFound;
+        notFoundNanos += nanosSince(start) * (long long)notFound / (long long)numAligned;
+    }
+    for (auto &overlap: pending)
+        finishOverlap(pCache, overlap);
+}
+
+void AbstractClip::printPrefilterStats()
+{
+    size_t regions = numRegions.load(), rejected = numRejected.load(), notFound = numNotFound.load();
+    double prefilterTime = prefilterNanos.load() * 1e-9;
+    // A rejected region would have cost as much as a region aligned in vain
+    double saved = notFound ? rejected * (notFoundNanos.load() * 1e-9 / notFound) - prefilterTime : 0.0;
+    size_t seeded = numSeeded.load();
+    fprintf(stderr, "[seeds] regions seeded: %zu without seeds: %zu bases aligned: %.2lf%% of the seeded regions\n",
+            seeded, numSeedRejected.load(), seededBases.load() ? 100.0 * alignedBases.load() / seededBases.load() : 0.0);
+    if (numExactTried.load() > 0) {
+        fprintf(stderr, "[exact overlaps] regions tried: %zu decided: %zu (%.2lf%%)\n", numExactTried.load(),
+                numExactFound.load(), 100.0 * numExactFound.load() / numExactTried.load());
+    }
+    if (numProfiles.load() > 0) {
+        fprintf(stderr, "[target groups] regions: %zu groups: %zu (%.2lf reads each)\n", numProfiledPairs.load(),
+                numProfiles.load(), (double)numProfiledPairs.load() / numProfiles.load());
+    }
+    if (numAlignmentBatches.load() > 0) {
+        fprintf(stderr, "[batch alignment] regions: %zu batches: %zu\n", numBatchedPairs.load(), numAlignmentBatches.load());
+    }
+    fprintf(stderr, "[prefilter] regions: %zu rejected: %zu (%.2lf%%) aligned without overlap: %zu prefilter time: %.3lfs estimated time saved: %.3lfs\n",
+            regions, rejected, regions ? 100.0 * rejected / regions : 0.0, notFound, prefilterTime, saved);
+}
+
+void AbstractClip::countStatus(ClipStatus status)
+{
+    numClips[status]++;
+}
+
+size_t AbstractClip::getNumClips(ClipStatus status)
+{
+    return numClips[status].load();
+}
+
+const char *AbstractClip::statusName(ClipStatus status)
+{
+    switch (status) {
+    case CLIP_CALLED: return "called";
+    case CLIP_INVALID_REGION: return "invalid region";
+    case CLIP_NO_SPANNING_PAIRS: return "no spanning pairs";
+    case CLIP_NO_TARGET_REGIONS: return "no target regions";
+    case CLIP_NO_OVERLAP: return "no overlap";
+    case CLIP_TOO_LONG: return "too long";
+    case CLIP_ERROR: return "errors";
+    default: return "unknown";
+    }
+}
+
+void AbstractClip::printStatusStats()
+{
+    fprintf(stderr, "[clip calls]");
+    for (int status = 0; status < NUM_CLIP_STATUSES; ++status)
+        fprintf(stderr, " %s: %zu", statusName((ClipStatus)status), getNumClips((ClipStatus)status));
+    fprintf(stderr, "\n");
 }
 
 bool AbstractClip::hasConflictWith(AbstractClip *other) {
@@ -98,23 +460,18 @@ Deletion ForwardBClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
 }
 */
 
-Deletion ForwardBClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity)
+ClipStatus ForwardBClip::call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity, vector<Deletion> &deletions)
 {
 //    error("No deletion is found.");
     ScoreParam score_param(1, -1, 2, 4);
+    ClipStatus status = CLIP_NO_OVERLAP;
     for (auto it = regions.begin(); it != regions.end(); ++it) {
-        string s1 = (*it).sequence(faidx);
-        reverse(s1.begin(), s1.end());
         string s2 = sequence;
         reverse(s2.begin(), s2.end());
 
         SequenceOverlap overlap;
-
-        try {
-            overlap = Overlapper::computeOverlapSW2(s1, s2, minOverlap, minIdentity, ungapped_params);
-        } catch (ErrorException& ex) {
+        if (!computeOverlap(faidx, pCache, *it, true, s2, minOverlap, minIdentity, overlap))
             continue;
-        }
 
         for (size_t i = 0; i < 2; ++i)
             overlap.match[i].flipStrand(overlap.length[i]);
@@ -153,10 +510,23 @@ Deletion ForwardBClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
 //            cout << s1 << endl;
 //        }
 
-        if (len > Helper::SVLEN_THRESHOLD) continue;
-        return Deletion((*it).referenceName, start1, start2, end1, end2, len, getType());
+        if (len > Helper::SVLEN_THRESHOLD) {
+            status = CLIP_TOO_LONG;
+            continue;
+        }
+        deletions.push_back(Deletion((*it).referenceName, start1, start2, end1, end2, len, getType()));
+        return CLIP_CALLED;
     }
-    error("No deletion is found.");
+    return status;
+}
+
+void ForwardBClip::addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions,
+                               int minOverlap, double minIdentity, OverlapBatch &batch)
+{
+    string s2 = sequence;
+    reverse(s2.begin(), s2.end());
+    for (auto &region: regions)
+        addOverlap(faidx, pCache, region, true, s2, minOverlap, minIdentity, batch);
 }
 
 string ForwardBClip::getType()
@@ -164,31 +534,37 @@ string ForwardBClip::getType()
     return "5F";
 }
 
-void ForwardBClip::fetchSpanningRanges(BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual)
+bool ForwardBClip::spanningRegion(int insLength, int &start, int &end)
 {
     // SVSeq2.length
-//    int start = leftmostPosition();
-    int start = clipPosition;
-//    int end = start + insLength + length();
-    int end = start + insLength - 2 * length();
+//    start = leftmostPosition();
+    start = clipPosition;
+//    end = start + insLength + length();
+    end = start + insLength - 2 * length();
+    return true;
+}
 
-    if (start > end) error("the region is invalid.");
+bool ForwardBClip::fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual)
+{
+    int start, end;
+    spanningRegion(insLength, start, end);
 
-    if (!reader.SetRegion(referenceId, start - 1, referenceId, end))
-        error("Could not set the region.");
+    if (start > end) return false;
 
-    BamAlignment al;
-    while(reader.GetNextAlignment(al)) {
+    vector<PairRecord> records;
+    source.fetch(referenceId, start - 1, end, records);
+
+    for (auto &r: records) {
 //        string xt;
 //        al.GetTag("XT", xt);
 //        xt = xt.substr(0,1);
-        if (al.IsReverseStrand() && !al.IsMateReverseStrand() && al.RefID == al.MateRefID
-                && al.MapQuality >= minMapQual //&& xt == "U"
-                && al.Position > al.MatePosition && al.MatePosition + length() - Helper::SVLEN_THRESHOLD <= clipPosition) {
-            ranges.push_back({al.MatePosition + 1, al.Position + 1});
+        if (r.bReverse && !r.bMateReverse && r.referenceId == r.mateReferenceId
+                && r.mapQuality >= minMapQual //&& xt == "U"
+                && r.position > r.matePosition && r.matePosition + length() - Helper::SVLEN_THRESHOLD <= clipPosition) {
+            ranges.push_back({r.matePosition + 1, r.position + 1});
         }
     }
-
+    return true;
 }
 
 void ForwardBClip::fecthSizesForSpanningPairs(BamReader &reader, int insLength, std::vector<int> &sizes)
@@ -285,33 +661,39 @@ ReverseEClip::ReverseEClip(int referenceId, int mapPosition, int clipPosition, i
     : AbstractClip(referenceId, mapPosition, clipPosition, matePosition, sequence, cigar) {
 }
 
-void ReverseEClip::fetchSpanningRanges(BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual)
+bool ReverseEClip::spanningRegion(int insLength, int &start, int &end)
 {
     // Experiment ID: SVSeq2.length
-    int start = clipPosition - insLength + length();
-//    int end = leftmostPosition() + length();
-//    int start = end - insLength - length();
+    start = clipPosition - insLength + length();
+//    end = leftmostPosition() + length();
+//    start = end - insLength - length();
     if (start < 0) start = 0;
-    int end = clipPosition - length();
+    end = clipPosition - length();
+    return true;
+}
 
-    if (start > end) error("the region is invalid.");
+bool ReverseEClip::fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual)
+{
+    int start, end;
+    spanningRegion(insLength, start, end);
 
-    if (!reader.SetRegion(referenceId, start - 1, referenceId, end))
-        error("Could not set the region.");
+    if (start > end) return false;
 
-    BamAlignment al;
-    while(reader.GetNextAlignment(al)) {
+    vector<PairRecord> records;
+    source.fetch(referenceId, start - 1, end, records);
+
+    for (auto &r: records) {
 //        string xt;
 //        al.GetTag("XT", xt);
 //        xt = xt.substr(0,1);
-        if (al.Position < start - 1) continue;
-        if (!al.IsReverseStrand() && al.IsMateReverseStrand() && al.RefID == al.MateRefID
-                && al.MapQuality >= minMapQual //&& xt == "U"
-                && al.Position < al.MatePosition && al.MatePosition >= clipPosition - Helper::SVLEN_THRESHOLD) {
-            ranges.push_back({al.Position + 1, al.MatePosition + 1});
+        if (r.position < start - 1) continue;
+        if (!r.bReverse && r.bMateReverse && r.referenceId == r.mateReferenceId
+                && r.mapQuality >= minMapQual //&& xt == "U"
+                && r.position < r.matePosition && r.matePosition >= clipPosition - Helper::SVLEN_THRESHOLD) {
+            ranges.push_back({r.position + 1, r.matePosition + 1});
         }
     }
-
+    return true;
 }
 
 void ReverseEClip::fecthSizesForSpanningPairs(BamReader &reader, int insLength, std::vector<int> &sizes)
@@ -365,21 +747,16 @@ Deletion ReverseEClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
 }
 */
 
-Deletion ReverseEClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity)
+ClipStatus ReverseEClip::call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity, vector<Deletion> &deletions)
 {
 //    error("No deletion is found.");
     ScoreParam score_param(1, -1, 2, 4);
+    ClipStatus status = CLIP_NO_OVERLAP;
 
     for (auto it = regions.rbegin(); it != regions.rend(); ++it) {
-        string s1 = (*it).sequence(faidx);
-        string s2 = sequence;
         SequenceOverlap overlap;
-
-        try {
-            overlap = Overlapper::computeOverlapSW2(s1, s2, minOverlap, minIdentity, ungapped_params);
-        } catch (ErrorException& ex) {
+        if (!computeOverlap(faidx, pCache, *it, false, sequence, minOverlap, minIdentity, overlap))
             continue;
-        }
 
 //        overlap = Overlapper::alignSuffix(s1, s2, ungapped_params);
 //        overlap = Overlapper::ageAlignSuffix(s1, s2, score_param);
@@ -412,10 +789,21 @@ Deletion ReverseEClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
 //            cout << s1 << endl;
 //        }
 
-        if (len > Helper::SVLEN_THRESHOLD) continue;
-        return Deletion((*it).referenceName, start1, start2, end1, end2, len, getType());
+        if (len > Helper::SVLEN_THRESHOLD) {
+            status = CLIP_TOO_LONG;
+            continue;
+        }
+        deletions.push_back(Deletion((*it).referenceName, start1, start2, end1, end2, len, getType()));
+        return CLIP_CALLED;
     }
-    error("No deletion is found.");
+    return status;
+}
+
+void ReverseEClip::addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions,
+                               int minOverlap, double minIdentity, OverlapBatch &batch)
+{
+    for (auto &region: regions)
+        addOverlap(faidx, pCache, region, false, sequence, minOverlap, minIdentity, batch);
 }
 
 string ReverseEClip::getType()
@@ -466,13 +854,13 @@ string ReverseBClip::getType()
     return "3R";
 }
 
-Deletion ReverseBClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity)
+ClipStatus ReverseBClip::call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity, vector<Deletion> &deletions)
 {
-    string s1 = regions[0].sequence(faidx);
-    reverse(s1.begin(), s1.end());
     string s2 = sequence;
     reverse(s2.begin(), s2.end());
-    SequenceOverlap overlap = Overlapper::computeOverlapSW2(s1, s2, minOverlap, minIdentity, ungapped_params);
+    SequenceOverlap overlap;
+    if (!computeOverlap(faidx, pCache, regions[0], true, s2, minOverlap, minIdentity, overlap))
+        return CLIP_NO_OVERLAP;
 
     for (size_t i = 0; i < 2; ++i)
         overlap.match[i].flipStrand(overlap.length[i]);
@@ -491,15 +879,23 @@ Deletion ReverseBClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
     int start2 = delta > 0 ? leftBp + delta : leftBp;
     int end1 = delta > 0 ? rightBp : rightBp + delta;
     int end2 = delta > 0 ? rightBp + delta : rightBp;
-    if (len > Helper::SVLEN_THRESHOLD) error("No deletion is found.");
-    return Deletion(regions[0].referenceName, start1, start2, end1, end2, len, getType());
+    if (len > Helper::SVLEN_THRESHOLD) return CLIP_TOO_LONG;
+    deletions.push_back(Deletion(regions[0].referenceName, start1, start2, end1, end2, len, getType()));
+    return CLIP_CALLED;
+}
 
-    error("No deletion is found.");
+void ReverseBClip::addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions,
+                               int minOverlap, double minIdentity, OverlapBatch &batch)
+{
+    string s2 = sequence;
+    reverse(s2.begin(), s2.end());
+    addOverlap(faidx, pCache, regions[0], true, s2, minOverlap, minIdentity, batch);
 }
 
-void ReverseBClip::fetchSpanningRanges(BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual)
+bool ReverseBClip::fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual)
 {
     ranges.push_back({matePosition + 1, clipPosition + 1});
+    return true;
 }
 
 void ReverseBClip::fecthSizesForSpanningPairs(BamReader &reader, int inslength, std::vector<int> &sizes)
@@ -549,10 +945,11 @@ string ForwardEClip::getType()
     return "3F";
 }
 
-Deletion ForwardEClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity)
+ClipStatus ForwardEClip::call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity, vector<Deletion> &deletions)
 {
-    string s1 = regions[0].sequence(faidx);
-    SequenceOverlap overlap = Overlapper::computeOverlapSW2(s1, sequence, minOverlap, minIdentity, ungapped_params);
+    SequenceOverlap overlap;
+    if (!computeOverlap(faidx, pCache, regions[0], false, sequence, minOverlap, minIdentity, overlap))
+        return CLIP_NO_OVERLAP;
 
     int delta = overlap.getOverlapLength() - lengthOfSoftclippedPart();
     int offset = 0;
@@ -570,15 +967,23 @@ Deletion ForwardEClip::call(FaidxWrapper &faidx, const std::vector<TargetRegion>
     int end2 = delta > 0 ? rightBp : rightBp - delta;
 
     if (len <= Helper::SVLEN_THRESHOLD) {
-        return Deletion(regions[0].referenceName, start1, start2, end1, end2, len, getType());
+        deletions.push_back(Deletion(regions[0].referenceName, start1, start2, end1, end2, len, getType()));
+        return CLIP_CALLED;
     }
 
-    error("No deletion is found.");
+    return CLIP_TOO_LONG;
+}
+
+void ForwardEClip::addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion> &regions,
+                               int minOverlap, double minIdentity, OverlapBatch &batch)
+{
+    addOverlap(faidx, pCache, regions[0], false, sequence, minOverlap, minIdentity, batch);
 }
 
-void ForwardEClip::fetchSpanningRanges(BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual)
+bool ForwardEClip::fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual)
 {
     ranges.push_back({clipPosition + 1, matePosition + 1});
+    return true;
 }
 
 void ForwardEClip::fecthSizesForSpanningPairs(BamReader &reader, int inslength, std::vector<int> &sizes)
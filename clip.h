@@ -2,13 +2,21 @@
 #define CLIP_H
 
 #include "api/BamAux.h"
+#include "Aligner.h"
+#include "AlignmentCache.h"
 #include "api/BamReader.h"
 #include "Deletion.h"
 #include "FaidxWrapper.h"
+#include "PairSource.h"
 #include "range.h"
+#include "SeedIndex.h"
 #include "Thirdparty/overlapper.h"
 
+#include <deque>
+#include <map>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 
@@ -27,6 +35,66 @@ struct TargetRegion
     }
 };
 
+// Why a clip calls no deletion. Most clips call none, so the reason is
+// returned rather than thrown; exceptions are left to the BAM and reference
+// files failing
+enum ClipStatus
+{
+    CLIP_CALLED = 0,            // the clip called a deletion, or is ready to
+    CLIP_INVALID_REGION,        // the region searched for spanning pairs is empty
+    CLIP_NO_SPANNING_PAIRS,
+    CLIP_NO_TARGET_REGIONS,
+    CLIP_NO_OVERLAP,            // no target region holds a qualified overlap
+    CLIP_TOO_LONG,              // the overlaps only make deletions above Helper::SVLEN_THRESHOLD
+    CLIP_ERROR,                 // reading the BAM or reference file failed
+    NUM_CLIP_STATUSES
+};
+
+// A target region overlapped with a clip sequence, up to the alignment: the
+// seeds, exact overlap and prefilter have been tried, and bAlign is set if
+// the alignment still has to decide
+struct PendingOverlap
+{
+    AlignmentKey key;
+    SequenceView target;    // the bases to align, narrowed to the seeds
+    int lo;                 // the first base of target in the region
+    int regionLength;
+    bool bAlign;
+    AlignmentResult result;
+};
+
+// The overlaps the clips of a batch are going to compute, aligned together
+// (see ClipCaller::call). Each target region is fetched once, and all reads
+// aligned to it go to Aligner::alignMany together, which for the ungapped
+// aligner scans them on one OverlapProfile of its bases. The reads that are
+// alone with their region go to Aligner::alignBatch instead, if there are
+// enough of them to fill its batch. All overlaps of a batch share minOverlap
+// and minIdentity
+class OverlapBatch
+{
+public:
+    // The result of an overlap added to the batch, once aligned
+    bool find(const AlignmentKey& key, AlignmentResult& result) const;
+
+    // Align the pending overlaps and put the results in the cache, if any
+    void align(AlignmentCache *pCache, Aligner& aligner);
+
+private:
+    friend class AbstractClip;
+
+    typedef std::tuple<std::string, int, int, bool> TargetKey;
+
+    bool contains(const AlignmentKey& key) const { return index.count(key) > 0; }
+    // The bases of region, reversed if bReversed, valid as long as the batch
+    SequenceView target(FaidxWrapper& faidx, const SeedIndex *pIndex, const TargetRegion& region, bool bReversed);
+    void add(const PendingOverlap& pending);
+
+    std::vector<PendingOverlap> pending;
+    std::vector<std::size_t> targetOf;      // the target of each pending overlap
+    std::deque<std::string> targets;
+    std::map<TargetKey, std::size_t> targetIndex;
+    std::unordered_map<AlignmentKey, std::size_t, AlignmentKeyHash> index;
+};
 
 class AbstractClip {
 public:
@@ -37,13 +105,67 @@ public:
     int length() const;
 
     int leftmostPosition() const;
+    int getReferenceId() const {
+        return referenceId;
+    }
     int getClipPosition() const {
         return clipPosition;
     }
 
     virtual ~AbstractClip();
 
-    Deletion call(BamTools::BamReader& reader, FaidxWrapper &faidx, int insLength, int minOverlap, double minIdentity, int minMapQual);
+    // Add the deletion of the clip to deletions, if it calls one
+    ClipStatus call(PairSource& source, const std::string& referenceName, FaidxWrapper &faidx, AlignmentCache *pCache, int insLength, int minOverlap, double minIdentity, int minMapQual, std::vector<Deletion>& deletions);
+    // The two halves of the call above, so that clips with the same target
+    // regions only have to find them once
+    ClipStatus findTargetRegions(PairSource& source, const std::string& referenceName, int insLength, int minMapQual, std::vector<TargetRegion>& regions);
+    virtual ClipStatus call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity, std::vector<Deletion>& deletions) = 0;
+
+    // The region [start, end] (1-based) searched for pairs spanning the clip;
+    // false if the clip does not look for spanning pairs
+    virtual bool spanningRegion(int insLength, int& start, int& end);
+    // Hand over the records of the spanning region collected by the reader,
+    // so that the clip does not have to query the BAM file itself
+    void setSpanningRecords(std::vector<PairRecord>& records);
+    bool hasSpanningRecords() const {
+        return bPrefetched;
+    }
+    // Look for seeds in the index of the window the target regions fall
+    // into, and align only around them; NULL to align whole regions. The
+    // narrowed target is not the whole region to the aligner: SW2 backtracks
+    // only its best endpoints, and these may differ, so a seeded overlap may
+    // qualify where the whole region has none, or the other way round
+    void setSeedIndex(const SeedIndex *pIndex) {
+        pSeedIndex = pIndex;
+    }
+    // Take the longest exact overlap with a target region if it qualifies,
+    // and align only if there is none. Faster for the many clips that match
+    // exactly, but an alignment may run on through a mismatch to a longer one
+    void setExactFirst(bool value) {
+        bExactFirst = value;
+    }
+
+    // Add the overlaps call would compute with these regions to batch, so
+    // that they are aligned together ahead of call
+    virtual void addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions,
+                             int minOverlap, double minIdentity, OverlapBatch& batch) = 0;
+    // Take the overlaps from an aligned batch; NULL to compute them one by one
+    void setOverlapBatch(const OverlapBatch *pBatch) {
+        pOverlapBatch = pBatch;
+    }
+    // Align with this aligner; NULL for Aligner::defaultAligner
+    void setAligner(Aligner *pAligner) {
+        this->pAligner = pAligner;
+    }
+
+    // Print how many target regions the seeds and the prefilter ruled out
+    // before alignment, over all threads
+    static void printPrefilterStats();
+    // Count the outcome of a clip, and print the counts over all threads
+    static void countStatus(ClipStatus status);
+    static std::size_t getNumClips(ClipStatus status);
+    static const char *statusName(ClipStatus status);
+    static void printStatusStats();
 
     bool hasConflictWith(AbstractClip *other);
     virtual std::string getType() = 0;
@@ -57,8 +179,18 @@ public:
 
 protected:
 
-    virtual Deletion call(FaidxWrapper &faidx, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity) = 0;
-    virtual void fetchSpanningRanges(BamTools::BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual) = 0;
+    // Overlap the clip sequence s2 with a target region by the aligner, or
+    // take the result from the overlap batch or the cache. If bReversed is
+    // set, s2 has been reversed and the target sequence is reversed as well.
+    bool computeOverlap(FaidxWrapper &faidx, AlignmentCache *pCache, const TargetRegion& region, bool bReversed,
+                        const std::string& s2, int minOverlap, double minIdentity, SequenceOverlap& overlap);
+    // The same for an overlap to be aligned later in batch, unless the
+    // cache or the batch already has it
+    void addOverlap(FaidxWrapper &faidx, AlignmentCache *pCache, const TargetRegion& region, bool bReversed,
+                    const std::string& s2, int minOverlap, double minIdentity, OverlapBatch& batch);
+
+    // False if the region searched for spanning pairs is empty
+    virtual bool fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual) = 0;
     virtual void fecthSizesForSpanningPairs(BamTools::BamReader &reader, int inslength, std::vector<int>& sizes) = 0;
     virtual void toTargetRegions(const std::string &referenceName, int insLength, std::vector<IRange> &ranges, std::vector<TargetRegion> &regions) = 0;
 
@@ -82,18 +214,38 @@ protected:
     std::vector<BamTools::CigarOp> cigar;
 
     bool conflictFlag;
+
+    bool bPrefetched;
+    std::vector<PairRecord> spanningRecords;
+
+    const SeedIndex *pSeedIndex;
+    bool bExactFirst;
+    const OverlapBatch *pOverlapBatch;
+    Aligner *pAligner;
+
+private:
+    // The key of an overlap, which tells whether it is aligned around seeds
+    AlignmentKey overlapKey(const TargetRegion& region, bool bReversed, const std::string& s2,
+                            int minOverlap, double minIdentity) const;
+    // Everything computeOverlap does before the alignment, with the bases of
+    // the region as fetched (and reversed)
+    void prepareOverlap(const SequenceView& bases, const TargetRegion& region, bool bReversed, const std::string& s2,
+                        int minOverlap, double minIdentity, PendingOverlap& pending);
 };
 
 class ForwardBClip : public AbstractClip {
 public:
     ForwardBClip(int referenceId, int mapPosition, int clipPosition, int matePosition, const std::string& sequence, const std::vector<BamTools::CigarOp>& cigar);
+    bool spanningRegion(int insLength, int& start, int& end);
 
 private:
-    virtual void fetchSpanningRanges(BamTools::BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual);
+    virtual bool fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual);
     virtual void fecthSizesForSpanningPairs(BamTools::BamReader& reader, int insLength, std::vector<int>& sizes);
     virtual void toTargetRegions(const std::string &referenceName, int insLength, std::vector<IRange> &ranges, std::vector<TargetRegion> &regions);
 
-    virtual Deletion call(FaidxWrapper &faidx, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity);    
+    virtual ClipStatus call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity, std::vector<Deletion>& deletions);    
+    virtual void addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions,
+                             int minOverlap, double minIdentity, OverlapBatch& batch);
 
     // AbstractClip interface
 public:
@@ -125,8 +277,10 @@ public:
     std::string getType();
 
 protected:
-    Deletion call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity);
-    void fetchSpanningRanges(BamTools::BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual);
+    ClipStatus call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity, std::vector<Deletion>& deletions);
+    void addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions,
+                     int minOverlap, double minIdentity, OverlapBatch& batch);
+    bool fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual);
     void fecthSizesForSpanningPairs(BamTools::BamReader &reader, int inslength, std::vector<int> &sizes);
     void toTargetRegions(const std::string &referenceName, int insLength, std::vector<IRange> &ranges, std::vector<TargetRegion> &regions);
     int lengthOfSoftclippedPart();
@@ -144,8 +298,10 @@ public:
     std::string getType();
 
 protected:
-    Deletion call(FaidxWrapper &faidx, const std::vector<TargetRegion> &regions, int minOverlap, double minIdentity);
-    void fetchSpanningRanges(BamTools::BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual);
+    ClipStatus call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity, std::vector<Deletion>& deletions);
+    void addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions,
+                     int minOverlap, double minIdentity, OverlapBatch& batch);
+    bool fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual);
     void fecthSizesForSpanningPairs(BamTools::BamReader &reader, int inslength, std::vector<int> &sizes);
     void toTargetRegions(const std::string &referenceName, int insLength, std::vector<IRange> &ranges, std::vector<TargetRegion> &regions);
     int lengthOfSoftclippedPart();
@@ -158,13 +314,16 @@ protected:
 class ReverseEClip : public AbstractClip {
 public:
     ReverseEClip(int referenceId, int mapPosition, int clipPosition, int matePosition, const std::string& sequence, const std::vector<BamTools::CigarOp>& cigar);
+    bool spanningRegion(int insLength, int& start, int& end);
 
 private:
-    virtual void fetchSpanningRanges(BamTools::BamReader &reader, int insLength, std::vector<IRange> &ranges, int minMapQual);
+    virtual bool fetchSpanningRanges(PairSource &source, int insLength, std::vector<IRange> &ranges, int minMapQual);
     virtual void fecthSizesForSpanningPairs(BamTools::BamReader& reader, int insLength, std::vector<int>& sizes);
     virtual void toTargetRegions(const std::string &referenceName, int insLength, std::vector<IRange> &ranges, std::vector<TargetRegion> &regions);
 
-    virtual Deletion call(FaidxWrapper &faidx, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity);
+    virtual ClipStatus call(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions, int minOverlap, double minIdentity, std::vector<Deletion>& deletions);
+    virtual void addOverlaps(FaidxWrapper &faidx, AlignmentCache *pCache, const std::vector<TargetRegion>& regions,
+                             int minOverlap, double minIdentity, OverlapBatch& batch);
 
     // AbstractClip interface
 public:
@@ -7,14 +7,18 @@
 #include <queue>
 
 #include "error.h"
+#include "Aligner.h"
 #include "Deletion.h"
 #include "ClipReader.h"
 #include "BamStatCalculator.h"
 #include "Helper.h"
 //#include "Parameters.h"
 #include "clip.h"
+#include "DeletionWriter.h"
+#include "ParallelCaller.h"
 #include "range.h"
 #include "Thirdparty/Timer.h"
+#include "Thirdparty/overlapper_simd.h"
 
 #include "easylogging++.h"
 
@@ -46,6 +50,20 @@ static const char *DFINDER_USAGE_MESSAGE =
 "      -m, --min-overlap=LEN            minimum overlap required between two reads (default: 12)\n"
 "      -q, --mapping-qual=MAPQ          minimum mapping quality of a read (default: 1)\n"
 "      -n, --allowed-num=SIZE           a soft-clip is defined as valid, when the clipped part is not less than SIZE (default: 5)\n"
+"      -t, --threads=N                  use N threads to call deletions (default: 1)\n"
+"          --region=REGION              only call clips in REGION, given as chr, chr:start or chr:start-end\n"
+"          --tile-size=N                split each chromosome (or REGION) into tiles of N bp that are called independently\n"
+"          --single-pass                collect the spanning pairs while reading the clips instead of querying BAMFILE for every clip\n"
+"          --cache-size=N               keep up to N alignment results for reuse by duplicate reads, 0 to disable (default: 65536)\n"
+"          --ref-cache=N                keep up to N blocks of 16 kb of the reference in memory per thread, 0 to disable (default: 256)\n"
+"          --resident-reference         keep the chromosome being called in memory, packed into 2 bits per base\n"
+"          --mmap-reference             map the (uncompressed) reference file into memory and share it between threads\n"
+"          --simd=LEVEL                 use at most LEVEL (avx2, sse4.1 or none) to align reads (default: the best the CPU supports)\n"
+"          --exact-first                take the longest exact overlap of a clip with a target region if it qualifies, and align only otherwise\n"
+"          --seeded                     align clips only around their k-mer seeds in the target regions; faster, but may change calls\n"
+"          --aligner=NAME               align clips to target regions by NAME (sw2, ungapped or exact, default: ungapped); exact only finds exact overlaps and changes calls\n"
+"          --shadow-aligner=NAME        align a sample of the overlaps by NAME (an aligner, or wfa) as well, and log where it differs from the aligner\n"
+"          --shadow-rate=F              the fraction of overlaps --shadow-aligner samples (default: 0.01)\n"
 "\nThe following two option must appear together (if ommitted, attempt ot learn the mean and the standard deviation of insert size):\n"
 "      -i, --insert-mean=N              the mean of insert size\n"
 "          --enhanced-mode              enable the enhanced mode, in which reads of type 2 are considered besides type 1\n"
@@ -63,15 +81,29 @@ namespace opt
     static int minMapQual = DEFAULT_MIN_MAPQUAL;
     static int allowedNum = 12;
     static int mode = 0;
+    static int numThreads = 1;
+    static std::string region;
+    static int tileSize = 0;
+    static bool bSinglePass = false;
+    static int cacheSize = 65536;
+    static int refCacheBlocks = 256;
+    static bool bResidentReference = false;
+    static bool bMappedReference = false;
+    static std::string simd;
+    static bool bExactFirst = false;
+    static bool bSeeded = false;
+    static std::string aligner = "ungapped";
+    static std::string shadowAligner;
+    static double shadowRate = 0.01;
 
     static bool bLearnInsert = true;
     static int insertMean;
     static int insertSd;
 }
 
-static const char* shortopts = "o:q:r:e:m:n:i:s:v";
+static const char* shortopts = "o:q:r:e:m:n:i:s:t:v";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_ENHANCED_MODE };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_ENHANCED_MODE, OPT_REGION, OPT_TILE_SIZE, OPT_SINGLE_PASS, OPT_CACHE_SIZE, OPT_REF_CACHE, OPT_RESIDENT_REFERENCE, OPT_MMAP_REFERENCE, OPT_SIMD, OPT_EXACT_FIRST, OPT_SEEDED, OPT_ALIGNER, OPT_SHADOW_ALIGNER, OPT_SHADOW_RATE };
 
 static const struct option longopts[] = {
     { "verbose",        no_argument,       NULL, 'v' },
@@ -83,14 +115,28 @@ static const struct option longopts[] = {
     { "error-rate",     required_argument, NULL, 'e' },
     { "insert-mean",    required_argument, NULL, 'i' },
     { "insert-sd",      required_argument, NULL, 's' },
+    { "threads",        required_argument, NULL, 't' },
     { "help",           no_argument,       NULL, OPT_HELP },
     { "version",        no_argument,       NULL, OPT_VERSION },
     { "enhanced-mode",  no_argument,       NULL, OPT_ENHANCED_MODE },
+    { "region",         required_argument, NULL, OPT_REGION },
+    { "tile-size",      required_argument, NULL, OPT_TILE_SIZE },
+    { "single-pass",    no_argument,       NULL, OPT_SINGLE_PASS },
+    { "cache-size",     required_argument, NULL, OPT_CACHE_SIZE },
+    { "ref-cache",      required_argument, NULL, OPT_REF_CACHE },
+    { "resident-reference", no_argument,   NULL, OPT_RESIDENT_REFERENCE },
+    { "mmap-reference", no_argument,       NULL, OPT_MMAP_REFERENCE },
+    { "simd",           required_argument, NULL, OPT_SIMD },
+    { "exact-first",    no_argument,       NULL, OPT_EXACT_FIRST },
+    { "seeded",         no_argument,       NULL, OPT_SEEDED },
+    { "aligner",        required_argument, NULL, OPT_ALIGNER },
+    { "shadow-aligner", required_argument, NULL, OPT_SHADOW_ALIGNER },
+    { "shadow-rate",    required_argument, NULL, OPT_SHADOW_RATE },
     { NULL, 0, NULL, 0 }
 };
 
 void parseOptions(int argc, char** argv);
-void output(const std::string& filename, const std::vector<Deletion>& dels);
+void makeShards(ClipReader& creader, int flank, std::vector<Shard>& shards);
 
 _INITIALIZE_EASYLOGGINGPP
 
@@ -137,33 +183,35 @@ int main(int argc, char *argv[]) {
 
     ClipReader creader(opt::bamFile, opt::allowedNum, opt::mode, opt::minMapQual, opt::insertMean + DEFAULT_SD_CUTOFF * opt::insertSd);
 
-    BamTools::BamReader bamReader;
-    if (!bamReader.Open(opt::bamFile))
-        error("Could not open the input BAM file.");
-    if (!bamReader.LocateIndex())
-        error("Could not locate the index file");
-
-    FaidxWrapper faidx(opt::refFile);
-
     int insLength = opt::insertMean + 3 * opt::insertSd;
     double identityRate = 1.0f - opt::errorRate;
+    Aligner *pAligner = Aligner::create(opt::aligner);
+    if (!opt::shadowAligner.empty())
+        pAligner = new ShadowAligner(pAligner, Aligner::create(opt::shadowAligner, true), opt::shadowRate);
+    CallParams params = { insLength, opt::minOverlap, identityRate, opt::minMapQual, opt::refCacheBlocks, opt::bExactFirst, opt::bSeeded, pAligner };
+    if (opt::bSinglePass) creader.setSinglePass(insLength);
 
-    std::vector<Deletion> deletions;
+    std::vector<std::string> referenceNames;
+    for (int id = 0; id < creader.getReferenceCount(); ++id)
+        referenceNames.push_back(creader.getReferenceName(id));
+    DeletionWriter writer(opt::outFile, referenceNames);
 
 //    Timer* pTimer = new Timer("Preprocessing split reads");
     Timer* pTimer = new Timer("Calling deletions");
-    AbstractClip *pClip;
-//    std::vector<AbstractClip*> clips;
-    while ((pClip = creader.nextClip())) {
-//        clips.push_back(pClip);
-        try {
-            auto del = pClip->call(bamReader, faidx, insLength, opt::minOverlap, identityRate, opt::minMapQual);
-            deletions.push_back(del);
-        } catch (ErrorException& ex) {
-    //            std::cout << ex.getMessage() << std::endl;
-        }
+    ParallelCaller::ReferenceMode referenceMode = ParallelCaller::REFERENCE_FAIDX;
+    if (opt::bResidentReference) referenceMode = ParallelCaller::REFERENCE_RESIDENT;
+    if (opt::bMappedReference) referenceMode = ParallelCaller::REFERENCE_MAPPED;
+    ParallelCaller caller(opt::bamFile, opt::refFile, params, opt::numThreads, opt::cacheSize, referenceMode);
+    if (opt::region.empty() && opt::tileSize <= 0) {
+        caller.run(creader, writer);
+    } else {
+        std::vector<Shard> shards;
+        makeShards(creader, insLength, shards);
+        caller.run(creader, shards, writer);
     }
+    writer.close();
     delete pTimer;
+    delete pAligner;
 
 //    std::cout << "# Soft-clipping reads: " << clips.size() << std::endl;
 
@@ -215,44 +263,10 @@ int main(int argc, char *argv[]) {
     delete pTimer;
     */
 
-    if (deletions.empty()) {
+    if (writer.size() == 0) {
         std::cout << "No deletion was found." << std::endl;
-        return 0;
     }
 
-    pTimer = new Timer("Merging deletions");
-    std::sort(deletions.begin(), deletions.end());
-    deletions.erase(std::unique(deletions.begin(), deletions.end()), deletions.end());
-
-//    std::vector<std::vector<Deletion> > delClusters;
-
-//    cluster(deletions, delClusters,
-//            [](const Deletion& d1, const Deletion& d2){ return d1.overlaps(d2); });
-
-    std::vector<Deletion> finalDels;
-    merge(deletions, finalDels,
-            [](const Deletion& d1, const Deletion& d2){ return d1.overlaps(d2); });
-//    finalDels.reserve(delClusters.size());
-//    for (auto &clu: delClusters) {
-//        finalDels.push_back(clu[0]);
-        /*
-        if (clu.size() == 1) finalDels.push_back(clu[0]);
-        else {
-            Deletion d(clu[0].getReferenceName(),
-                    clu[0].getStart1(),
-                    clu[clu.size()-1].getEnd1(),
-                    clu[0].getStart2(),
-                    clu[clu.size()-1].getEnd2(),
-                    clu[0].getLength(),
-                    clu[0].getFromTag());
-            finalDels.push_back(d);
-        }
-        */
-//    }
-    delete pTimer;
-
-    output(opt::outFile, finalDels);
-
     return 0;
 }
 
@@ -279,7 +293,21 @@ void parseOptions(int argc, char** argv)
             case 'v': opt::verbose++; break;
             case 'i': arg >> opt::insertMean; bInsertMean = true; break;
             case 's': arg >> opt::insertSd; bInsertSd = true; break;
+            case 't': arg >> opt::numThreads; break;
             case OPT_ENHANCED_MODE: opt::mode = 1; break;
+            case OPT_REGION: arg >> opt::region; break;
+            case OPT_TILE_SIZE: arg >> opt::tileSize; break;
+            case OPT_SINGLE_PASS: opt::bSinglePass = true; break;
+            case OPT_CACHE_SIZE: arg >> opt::cacheSize; break;
+            case OPT_REF_CACHE: arg >> opt::refCacheBlocks; break;
+            case OPT_RESIDENT_REFERENCE: opt::bResidentReference = true; break;
+            case OPT_MMAP_REFERENCE: opt::bMappedReference = true; break;
+            case OPT_SIMD: arg >> opt::simd; break;
+            case OPT_EXACT_FIRST: opt::bExactFirst = true; break;
+            case OPT_SEEDED: opt::bSeeded = true; break;
+            case OPT_ALIGNER: arg >> opt::aligner; break;
+            case OPT_SHADOW_ALIGNER: arg >> opt::shadowAligner; break;
+            case OPT_SHADOW_RATE: arg >> opt::shadowRate; break;
             case OPT_HELP:
                 std::cout << DFINDER_USAGE_MESSAGE;
                 exit(EXIT_SUCCESS);
@@ -315,6 +343,66 @@ void parseOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads < 1)
+    {
+        std::cerr << PROGRAM_NAME ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
+    if(opt::cacheSize < 0)
+    {
+        std::cerr << PROGRAM_NAME ": invalid cache size: " << opt::cacheSize << "\n";
+        die = true;
+    }
+
+    if(opt::refCacheBlocks < 0)
+    {
+        std::cerr << PROGRAM_NAME ": invalid reference cache size: " << opt::refCacheBlocks << "\n";
+        die = true;
+    }
+
+    if(opt::simd == "none")
+        OverlapperSIMD::setMaxLevel(OverlapperSIMD::SCALAR);
+    else if(opt::simd == "sse4.1")
+        OverlapperSIMD::setMaxLevel(OverlapperSIMD::SSE41);
+    else if(!opt::simd.empty() && opt::simd != "avx2")
+    {
+        std::cerr << PROGRAM_NAME ": invalid SIMD level: " << opt::simd << "\n";
+        die = true;
+    }
+
+    if(!Aligner::isKnown(opt::aligner))
+    {
+        std::cerr << PROGRAM_NAME ": invalid aligner: " << opt::aligner << "\n";
+        die = true;
+    }
+
+    if(!opt::shadowAligner.empty() && !Aligner::isKnown(opt::shadowAligner, true))
+    {
+        std::cerr << PROGRAM_NAME ": invalid shadow aligner: " << opt::shadowAligner << "\n";
+        die = true;
+    }
+
+    if(opt::shadowRate <= 0 || opt::shadowRate > 1)
+    {
+        std::cerr << PROGRAM_NAME ": invalid shadow rate: " << opt::shadowRate << "\n";
+        die = true;
+    }
+
+    if(opt::bResidentReference && opt::bMappedReference)
+    {
+        std::cerr << PROGRAM_NAME ": --resident-reference and --mmap-reference cannot be used together\n";
+        die = true;
+    }
+
+    std::string regionName;
+    int regionStart, regionEnd;
+    if(!opt::region.empty() && !parseRegion(opt::region, regionName, regionStart, regionEnd))
+    {
+        std::cerr << PROGRAM_NAME ": invalid region: " << opt::region << "\n";
+        die = true;
+    }
+
     if(opt::refFile.empty())
     {
         std::cerr << PROGRAM_NAME ": the reference file must be specified\n";
@@ -342,9 +430,25 @@ void parseOptions(int argc, char** argv)
 
 }
 
-void output(const std::string &filename, const std::vector<Deletion> &dels) {
-    std::ofstream out(filename.c_str());
-    size_t i = 1;
-    std::for_each(std::begin(dels), std::end(dels), [&i, &out](const Deletion &d)
-    {out << d << "\tDEL." << i << "." << d.getFromTag() << std::endl; i++;});
+//
+// Split the --region, or every reference in the BAM header, into shards
+//
+void makeShards(ClipReader &creader, int flank, std::vector<Shard> &shards)
+{
+    if (opt::region.empty()) {
+        for (int id = 0; id < creader.getReferenceCount(); ++id)
+            tileRegion(id, 1, creader.getReferenceLength(id), opt::tileSize, flank, shards);
+        return;
+    }
+
+    std::string name;
+    int start, end;
+    parseRegion(opt::region, name, start, end);
+    int id = creader.getReferenceId(name);
+    if (id < 0) error("Could not find the reference of the region " + opt::region);
+    int length = creader.getReferenceLength(id);
+    if (start == 0) start = 1;
+    if (end == 0 || end > length) end = length;
+    if (start > end) error("The region " + opt::region + " is outside of the reference");
+    tileRegion(id, start, end, opt::tileSize, flank, shards);
 }